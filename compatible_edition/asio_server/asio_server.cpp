@@ -4,6 +4,7 @@
 //configuration
 #define ST_ASIO_SERVER_PORT		9528
 #define ST_ASIO_ASYNC_ACCEPT_NUM	5
+//#define ST_ASIO_ACCEPTOR_NUM		4 //4 acceptors bound with SO_REUSEPORT, the kernel distributes new connections among them
 #define ST_ASIO_REUSE_OBJECT //use objects pool
 //#define ST_ASIO_FREE_OBJECT_INTERVAL	60 //it's useless if ST_ASIO_REUSE_OBJECT macro been defined
 //#define ST_ASIO_FORCE_TO_USE_MSG_RECV_BUFFER //force to use the msg recv buffer
@@ -11,13 +12,17 @@
 #define ST_ASIO_FULL_STATISTIC //full statistic will slightly impact efficiency.
 //#define ST_ASIO_USE_STEADY_TIMER
 //#define ST_ASIO_USE_SYSTEM_TIMER
+//#define ST_ASIO_USE_TIMER_WHEEL //all timers in one io_service share one timer wheel, see st_asio_wrapper_timer.h
+//#define ST_ASIO_INPUT_QUEUE lock_free_queue //many threads (service threads and the main thread) send msgs to the same socket, lock_free_queue avoids contention on lock_queue
+//#define ST_ASIO_DISPATCH_BATCH_MSG 64 //fetch and dispatch at most 64 msgs at a time, on_msg_handle_batch() will call on_msg_handle() for each of them
 
 //use the following macro to control the type of packer and unpacker
 #define PACKER_UNPACKER_TYPE	0
 //0-default packer and unpacker, head(length) + body
 //1-default replaceable_packer and replaceable_unpacker, head(length) + body
-//2-fixed length unpacker
+//2-fixed length unpacker, define ST_ASIO_BUFFER_POOL to allocate msgs (basic_buffer) from buffer_pool instead of new operator
 //3-prefix and suffix packer and unpacker
+//#define ST_ASIO_BUFFER_POOL
 
 #if 1 == PACKER_UNPACKER_TYPE
 #define ST_ASIO_DEFAULT_PACKER replaceable_packer<>
@@ -41,6 +46,9 @@ using namespace st_asio_wrapper::ext;
 #define LIST_STATUS		"status"
 #define SUSPEND_COMMAND	"suspend"
 #define RESUME_COMMAND	"resume"
+#define SUBSCRIBE_COMMAND	"subscribe"
+#define UNSUBSCRIBE_COMMAND	"unsubscribe"
+#define PUBLISH_COMMAND	"publish"
 
 //demonstrate how to use custom packer
 //under the default behavior, each st_tcp_socket has their own packer, and cause memory waste
@@ -142,9 +150,12 @@ public:
 	statistic get_statistic()
 	{
 		statistic stat;
-		boost::shared_lock<boost::shared_mutex> lock(ST_THIS object_can_mutex);
-		for (BOOST_AUTO(iter, ST_THIS object_can.begin()); iter != ST_THIS object_can.end(); ++iter)
-			stat += (*iter)->get_statistic();
+		for (size_t i = 0; i < ST_THIS shard_num(); ++i)
+		{
+			boost::shared_lock<boost::shared_mutex> lock(ST_THIS shards[i].object_can_mutex);
+			for (BOOST_AUTO(iter, ST_THIS shards[i].object_can.begin()); iter != ST_THIS shards[i].object_can.end(); ++iter)
+				stat += (*iter)->get_statistic();
+		}
 
 		return stat;
 	}
@@ -153,6 +164,10 @@ public:
 	virtual void test() {/*puts("in echo_server::test()");*/}
 };
 
+template<typename Server>
+void subscribe_topic(Server& server, const std::string& topic, bool subscribe, typename Server::object_ctype& item)
+	{if (subscribe) server.subscribe(topic, item->id()); else server.unsubscribe(topic, item->id());}
+
 int main(int argc, const char* argv[])
 {
 	printf("usage: %s [<service thread number=1> [<port=%d> [ip=0.0.0.0]]]\n", argv[0], ST_ASIO_SERVER_PORT);
@@ -207,14 +222,37 @@ int main(int argc, const char* argv[])
 		{
 			printf("normal server, link #: " ST_ASIO_SF ", invalid links: " ST_ASIO_SF "\n", server_.size(), server_.invalid_object_size());
 			printf("echo server, link #: " ST_ASIO_SF ", invalid links: " ST_ASIO_SF "\n", echo_server_.size(), echo_server_.invalid_object_size());
+			printf("normal server, %s\n", server_.get_publish_statistic().to_string().data());
 			puts("");
 			puts(echo_server_.get_statistic().to_string().data());
+			for (size_t i = 0; i < echo_server_.acceptor_num(); ++i)
+				printf("acceptor #" ST_ASIO_SF ": %s\n", i, echo_server_.get_accept_statistic(i).to_string().data());
+#ifdef ST_ASIO_BUFFER_POOL
+			printf("buffer pool: %s\n", buffer_pool::instance().get_statistic().to_string().data());
+#endif
 		}
 		//the following two commands demonstrate how to suspend msg dispatching, no matter recv buffer been used or not
 		else if (SUSPEND_COMMAND == str)
 			echo_server_.do_something_to_all(boost::bind(&echo_socket::suspend_dispatch_msg, _1, true));
 		else if (RESUME_COMMAND == str)
 			echo_server_.do_something_to_all(boost::bind(&echo_socket::suspend_dispatch_msg, _1, false));
+		//the following three commands demonstrate topic based publish/subscribe: all clients from normal server (asio_client) subscribe or
+		//unsubscribe a topic (like 'subscribe news'), then msgs can be published to it (like 'publish news hello'), clients that didn't subscribe it get nothing.
+		else if (SUBSCRIBE_COMMAND == str || UNSUBSCRIBE_COMMAND == str)
+		{
+			std::string topic;
+			std::cin >> topic;
+			bool subscribe = SUBSCRIBE_COMMAND == str;
+			server_.do_something_to_all(boost::bind(&subscribe_topic<st_server_base<normal_server_socket> >, boost::ref(server_), boost::cref(topic), subscribe, _1));
+			printf("topic %s has " ST_ASIO_SF " subscriber(s).\n", topic.data(), server_.subscriber_num(topic));
+		}
+		else if (PUBLISH_COMMAND == str)
+		{
+			std::string topic, msg;
+			std::cin >> topic >> msg;
+			//the msg will be packed only once, like shared_broadcast_msg, send \0 character too (see below)
+			printf("published to " ST_ASIO_SF " subscriber(s).\n", server_.publish(topic, msg.data(), msg.size() + 1));
+		}
 		else if (LIST_ALL_CLIENT == str)
 		{
 			puts("clients from normal server:");
@@ -229,13 +267,10 @@ int main(int argc, const char* argv[])
 			//send \0 character too, because asio_client used basic_buffer as its msg type, it will not append \0 character automatically as std::string does,
 			//so need \0 character when printing it.
 
-			//if all clients used the same protocol, we can pack msg one time, and send it repeatedly like this:
-			packer p;
-			packer::msg_type msg;
+			//if all clients used the same protocol, we can pack msg one time (with server_'s own packer), and send it repeatedly like this:
+			server_.shared_broadcast_msg(str.data(), str.size() + 1);
 			//send \0 character too, because asio_client used basic_buffer as its msg type, it will not append \0 character automatically as std::string does,
 			//so need \0 character when printing it.
-			if (p.pack_msg(msg, str.data(), str.size() + 1))
-				server_.do_something_to_all(boost::bind((bool (normal_server_socket::*)(packer::msg_ctype&, bool)) &normal_server_socket::direct_send_msg, _1, boost::cref(msg), false));
 
 			//if asio_client is using stream_unpacker
 //			if (!str.empty())
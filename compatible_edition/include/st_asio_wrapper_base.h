@@ -23,6 +23,7 @@
 #include <sstream>
 
 #include <boost/asio.hpp>
+#include <boost/array.hpp>
 #include <boost/bind.hpp>
 #include <boost/date_time.hpp>
 #include <boost/smart_ptr.hpp>
@@ -39,6 +40,25 @@
 	#error message buffer size must be bigger than zero.
 #endif
 
+//send big msgs by sendmsg with MSG_ZEROCOPY and file-backed msgs (see fd_buffer) by sendfile, linux (4.14 or higher) only, plain tcp only.
+//msgs sent by MSG_ZEROCOPY are held until the kernel reports the completion via the socket's error queue, so they will be released later than before.
+//if the kernel reports that it copied the data anyway (for example, via loopback), MSG_ZEROCOPY will be disabled on that socket.
+//with ST_ASIO_WANT_MSG_SEND_NOTIFY, MSG_ZEROCOPY will not be used (sendfile still will), because msgs handed to on_msg_send() may be
+//modified or reused while the kernel is still reading them.
+#ifdef ST_ASIO_ZEROCOPY_SEND
+#ifndef __linux__
+#error ST_ASIO_ZEROCOPY_SEND is only available on linux.
+#endif
+#include <unistd.h>
+//a sending (maybe consist of more than one msgs) whose size is less than this value will not use MSG_ZEROCOPY,
+//the page pinning and the completion notification make zero copy only effective for big sendings (around 10K and up).
+#ifndef ST_ASIO_ZEROCOPY_THRESHOLD
+#define ST_ASIO_ZEROCOPY_THRESHOLD	(16 * 1024)
+#elif ST_ASIO_ZEROCOPY_THRESHOLD <= 0
+	#error zero copy threshold must be bigger than zero.
+#endif
+#endif
+
 #if defined _MSC_VER
 #define ST_ASIO_SF "%Iu"
 #define ST_THIS //workaround to make up the BOOST_AUTO's defect under vc2008 and compiler bugs before vc2012
@@ -132,6 +152,62 @@ protected:
 };
 //not like auto_buffer, shared_buffer is copyable, but auto_buffer is a bit more efficient.
 
+//put msg into the gather list of an async_write, msg types which consist of more than one buffer (for example, ext::scatter_buffer)
+//overload it in their own namespace (found by ADL), then st_tcp_socket_base will send them without concatenation.
+template<typename T, typename Buffers>
+inline void gather_buffers(const T& msg, Buffers& bufs) {bufs.push_back(boost::asio::buffer(msg.data(), msg.size()));}
+
+#ifdef ST_ASIO_ZEROCOPY_SEND
+//a region of a file, msgs refer to it are sent by sendfile without copying the file content to user space.
+struct file_region
+{
+	int fd;
+	off_t offset;
+	size_t size;
+};
+
+//a file-backed buffer, send it via replaceable_buffer or shared_buffer<i_buffer> by direct_send_msg (it cannot be packed),
+//only plain tcp sockets (not ssl) can send it, others fail the sending with boost::asio::error::operation_not_supported (see on_send_error()).
+//it takes the ownership of fd (close it when destroyed), use dup() to keep yours.
+class fd_buffer : public i_buffer, public boost::noncopyable
+{
+public:
+	fd_buffer(int fd, off_t offset, size_t size) {region.fd = fd; region.offset = offset; region.size = size;}
+	~fd_buffer() {if (region.fd >= 0) ::close(region.fd);}
+
+	const file_region& get_region() const {return region;}
+
+	virtual bool empty() const {return 0 == region.size;}
+	virtual size_t size() const {return region.size;}
+	virtual const char* data() const {return NULL;} //the content is not in memory
+
+protected:
+	file_region region;
+};
+
+//return true and the file region if msg is file-backed, st_tcp_socket_base sends it by sendfile, overload it (found by ADL) for
+//msg types which can carry a fd_buffer, the following two overloads cover replaceable_buffer and shared_buffer<i_buffer>.
+template<typename T> inline bool get_file_region(const T& msg, file_region& region) {return false;}
+inline bool get_file_region(const auto_buffer<i_buffer>& msg, file_region& region)
+{
+	const fd_buffer* buff = dynamic_cast<const fd_buffer*>(msg.raw_buffer());
+	if (NULL == buff)
+		return false;
+
+	region = buff->get_region();
+	return true;
+}
+inline bool get_file_region(const shared_buffer<i_buffer>& msg, file_region& region)
+{
+	const fd_buffer* buff = dynamic_cast<const fd_buffer*>(msg.raw_buffer().get());
+	if (NULL == buff)
+		return false;
+
+	region = buff->get_region();
+	return true;
+}
+#endif
+
 //packer concept
 template<typename MsgType>
 class i_packer
@@ -183,6 +259,16 @@ public:
 	virtual bool parse_msg(size_t bytes_transferred, container_type& msg_can) = 0;
 	virtual size_t completion_condition(const boost::system::error_code& ec, size_t bytes_transferred) = 0;
 	virtual boost::asio::mutable_buffers_1 prepare_next_recv() = 0;
+
+	//st_tcp_socket_base receives data into the buffers returned by this function, unpackers which can receive data into two discontinuous
+	//buffers at once (for example, ext::ring_unpacker, its free space wraps around) can override it, the default one just uses prepare_next_recv.
+	typedef boost::array<boost::asio::mutable_buffer, 2> buffers_type;
+	virtual buffers_type prepare_next_recv_buffers() {buffers_type buffers = {{*prepare_next_recv().begin(), boost::asio::mutable_buffer()}}; return buffers;}
+
+	//return true if the unpacker has neither half-baked msgs nor receive buffer (see ext::recv_buffer and ST_ASIO_LAZY_RECV_BUFFER), then
+	//st_tcp_socket_base (except ssl sockets) will wait until the socket becomes readable before calling prepare_next_recv_buffers, so idle sockets
+	//occupy no receive buffers.
+	virtual bool idle() const {return false;}
 };
 
 template<typename MsgType>
@@ -213,9 +299,27 @@ public:
 	virtual void reset_state() {}
 	virtual void parse_msg(msg_type& msg, size_t bytes_transferred) = 0;
 	virtual boost::asio::mutable_buffers_1 prepare_next_recv() = 0;
+	//see i_unpacker::idle for more details.
+	virtual bool idle() const {return false;}
 };
 //unpacker concept
 
+//hold a packer or an unpacker by value instead of by boost::shared_ptr (see ST_ASIO_STATIC_PACKER and ST_ASIO_STATIC_UNPACKER), it can be used
+//like a pointer, but since the held object is a member, its dynamic type is known, calls via operator-> are not virtual any more (compilers
+//resolve them at compile time), so they can be inlined.
+template<typename T>
+class static_object : public boost::noncopyable
+{
+public:
+	T* operator->() {return &obj;}
+	const T* operator->() const {return &obj;}
+	T& operator*() {return obj;}
+	const T& operator*() const {return obj;}
+
+private:
+	T obj;
+};
+
 struct statistic
 {
 #ifdef ST_ASIO_FULL_STATISTIC
@@ -232,13 +336,13 @@ struct statistic
 	static stat_time local_time() {return stat_time();}
 	typedef dummy_duration stat_duration;
 #endif
-	statistic() : send_msg_sum(0), send_byte_sum(0), recv_msg_sum(0), recv_byte_sum(0) {}
+	statistic() : send_msg_sum(0), send_byte_sum(0), recv_msg_sum(0), recv_byte_sum(0), redispatch_sum(0) {}
 	void reset()
 	{
 		send_msg_sum = send_byte_sum = 0;
 		send_delay_sum = send_time_sum = stat_duration();
 
-		recv_msg_sum = recv_byte_sum = 0;
+		recv_msg_sum = recv_byte_sum = redispatch_sum = 0;
 		dispatch_dealy_sum = recv_idle_sum = stat_duration();
 #ifndef ST_ASIO_FORCE_TO_USE_MSG_RECV_BUFFER
 		handle_time_1_sum = stat_duration();
@@ -255,6 +359,7 @@ struct statistic
 
 		recv_msg_sum += other.recv_msg_sum;
 		recv_byte_sum += other.recv_byte_sum;
+		redispatch_sum += other.redispatch_sum;
 		dispatch_dealy_sum += other.dispatch_dealy_sum;
 		recv_idle_sum += other.recv_idle_sum;
 #ifndef ST_ASIO_FORCE_TO_USE_MSG_RECV_BUFFER
@@ -278,6 +383,7 @@ struct statistic
 			<< "\nrecv corresponding statistic:\n"
 			<< "message sum: " << recv_msg_sum << std::endl
 			<< "size in bytes: " << recv_byte_sum << std::endl
+			<< "re-dispatch times: " << redispatch_sum << std::endl
 			<< "dispatch delay: " << dispatch_dealy_sum.total_seconds() << "." << std::setw(tw) << dispatch_dealy_sum.fractional_seconds() << std::setw(0) << std::endl
 			<< "recv idle duration: " << recv_idle_sum.total_seconds() << "." << std::setw(tw) << recv_idle_sum.fractional_seconds() << std::setw(0) << std::endl
 #ifndef ST_ASIO_FORCE_TO_USE_MSG_RECV_BUFFER
@@ -290,7 +396,8 @@ struct statistic
 			<< "size in bytes: " << send_byte_sum << std::endl
 			<< "\nrecv corresponding statistic:\n"
 			<< "message sum: " << recv_msg_sum << std::endl
-			<< "size in bytes: " << recv_byte_sum;
+			<< "size in bytes: " << recv_byte_sum << std::endl
+			<< "re-dispatch times: " << redispatch_sum;
 #endif
 		return s.str();
 	}
@@ -305,6 +412,7 @@ struct statistic
 	//recv corresponding statistic
 	boost::uint_fast64_t recv_msg_sum; //include msgs in receiving buffer
 	boost::uint_fast64_t recv_byte_sum; //include msgs in receiving buffer
+	boost::uint_fast64_t redispatch_sum; //how many times on_msg_handle() returned false, which means msgs been re-dispatched
 	stat_duration dispatch_dealy_sum; //from parse_msg(exclude msg unpacking) to on_msg_handle
 	stat_duration recv_idle_sum;
 	//during this duration, st_socket suspended msg reception (receiving buffer overflow, msg dispatching suspended or doing congestion control)
@@ -377,7 +485,8 @@ template<typename _Predicate> void NAME(const _Predicate& __pred) const {for (BO
 }
 
 #define GET_PENDING_MSG_NUM(FUNNAME, CAN) size_t FUNNAME() const {return CAN.size();}
-#define POP_FIRST_PENDING_MSG(FUNNAME, CAN, MSGTYPE) void FUNNAME(MSGTYPE& msg) {msg.clear(); CAN.try_dequeue(msg);}
+#define GET_PENDING_MSG_BYTES(FUNNAME, CAN) size_t FUNNAME() const {return CAN.size_in_bytes();}
+#define POP_FIRST_PENDING_MSG(FUNNAME, CAN, MSGTYPE) void FUNNAME(MSGTYPE& msg) {msg.clear(); obj_with_begin_time<MSGTYPE> unused; if (CAN.try_dequeue(unused)) msg.swap(unused);}
 #define POP_ALL_PENDING_MSG(FUNNAME, CAN, CANTYPE) void FUNNAME(CANTYPE& msg_queue) {msg_queue.clear(); CAN.swap(msg_queue);}
 
 ///////////////////////////////////////////////////
@@ -399,7 +508,8 @@ bool FUNNAME(const char* const pstr[], const size_t len[], size_t num, bool can_
 TCP_SEND_MSG_CALL_SWITCH(FUNNAME, bool)
 
 //guarantee send msg successfully even if can_overflow equal to false, success at here just means putting the msg into st_tcp_socket's send buffer successfully
-//if can_overflow equal to false and the buffer is not available, will wait until it becomes available
+//if can_overflow equal to false and the buffer is not available, will wait until it becomes available (by sleeping, so do not call it in service threads),
+//st_socket::async_wait_writable() and st_socket::on_send_buffer_low() are the non-blocking alternatives.
 #define TCP_SAFE_SEND_MSG(FUNNAME, SEND_FUNNAME) \
 bool FUNNAME(const char* const pstr[], const size_t len[], size_t num, bool can_overflow = false) {while (!SEND_FUNNAME(pstr, len, num, can_overflow)) SAFE_SEND_MSG_CHECK return true;} \
 TCP_SEND_MSG_CALL_SWITCH(FUNNAME, bool)
@@ -408,6 +518,18 @@ TCP_SEND_MSG_CALL_SWITCH(FUNNAME, bool)
 void FUNNAME(const char* const pstr[], const size_t len[], size_t num, bool can_overflow = false) \
 	{ST_THIS do_something_to_all(boost::bind(&Socket::SEND_FUNNAME, _1, pstr, len, num, can_overflow));} \
 TCP_SEND_MSG_CALL_SWITCH(FUNNAME, void)
+
+//pack msg only once with the broadcaster's own packer (see inner_packer() of st_server_base and st_tcp_client_base), then put the same packed msg into
+//all objects' send buffers, so that packer must pack msgs exactly as all objects' packers do. if msg type is shared_buffer (for example, shared_packer),
+//all objects share one buffer (only reference counting), otherwise (for example, std::string), every object still gets a copy, but packing happens only once.
+#define TCP_SHARED_BROADCAST_MSG(FUNNAME, NATIVE) \
+void FUNNAME(const char* const pstr[], const size_t len[], size_t num, bool can_overflow = false) \
+{ \
+	typename Socket::in_msg_type msg; \
+	if (ST_THIS broadcast_packer_->pack_msg(msg, pstr, len, num, NATIVE) && !msg.empty()) \
+		ST_THIS do_something_to_all(boost::bind((bool (Socket::*)(typename Socket::in_msg_ctype&, bool)) &Socket::direct_send_msg, _1, boost::cref(msg), can_overflow)); \
+} \
+TCP_SEND_MSG_CALL_SWITCH(FUNNAME, void)
 //TCP msg sending interface
 ///////////////////////////////////////////////////
 
@@ -0,0 +1,39 @@
+/*
+ * st_asio_wrapper_future.h
+ *
+ *  Created on: 2026-10-17
+ *      Author: youngwolf
+ *		email: mail2tao@163.com
+ *		QQ: 676218192
+ *		Community on QQ: 198941541
+ *
+ * future versions of st_socket's asynchronous waiting, boost/thread/future.hpp is heavy, so only include this file if you need them.
+ */
+
+#ifndef ST_ASIO_WRAPPER_FUTURE_H_
+#define ST_ASIO_WRAPPER_FUTURE_H_
+
+#include <boost/thread/future.hpp>
+
+#include "st_asio_wrapper_socket.h"
+
+namespace st_asio_wrapper
+{
+
+inline void set_promise(const boost::shared_ptr<boost::promise<void> >& p) {p->set_value();}
+
+//the future version of st_socket::async_wait_writable, if the socket been reset or destroyed before the send buffer became available,
+//the future will get a broken_promise exception.
+//return shared_future because unique_future cannot be returned by value without rvalue references.
+template<typename Socket>
+boost::shared_future<void> wait_writable(Socket& socket)
+{
+	BOOST_AUTO(p, boost::make_shared<boost::promise<void> >());
+	boost::shared_future<void> f(p->get_future());
+	socket.async_wait_writable(boost::bind(&set_promise, p));
+	return f;
+}
+
+} //namespace
+
+#endif /* ST_ASIO_WRAPPER_FUTURE_H_ */
@@ -28,9 +28,13 @@ protected:
 
 public:
 	bool stopped() const {return io_service_.stopped();}
+	boost::asio::io_service& get_io_service() {return io_service_;}
 
 #ifdef ST_ASIO_ENHANCED_STABILITY
 	void post(const boost::function<void()>& handler) {io_service_.post(boost::bind(&st_object::post_handler, this, async_call_indicator, handler));}
+	//post to another io_service (see ST_ASIO_IO_SERVICE_PER_THREAD), it's still an async call of this st_object
+	void post(boost::asio::io_service& io_service, const boost::function<void()>& handler)
+		{io_service.post(boost::bind(&st_object::post_handler, this, async_call_indicator, handler));}
 	bool is_async_calling() const {return !async_call_indicator.unique();}
 	bool is_last_async_call() const {return async_call_indicator.use_count() <= 2;} //can only be called in callbacks
 
@@ -53,6 +57,8 @@ protected:
 #else
 	template<typename CallbackHandler>
 	void post(const CallbackHandler& handler) {io_service_.post(handler);}
+	template<typename CallbackHandler>
+	void post(boost::asio::io_service& io_service, const CallbackHandler& handler) {io_service.post(handler);}
 	bool is_async_calling() const {return false;}
 	bool is_last_async_call() const {return true;}
 
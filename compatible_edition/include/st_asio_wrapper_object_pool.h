@@ -19,6 +19,7 @@
 #include <boost/atomic.hpp>
 #endif
 #include <boost/unordered_set.hpp>
+#include <vector>
 
 #include "st_asio_wrapper_timer.h"
 #include "st_asio_wrapper_service_pump.h"
@@ -29,6 +30,15 @@
 	#error object capacity must be bigger than zero.
 #endif
 
+//st_object_pool spreads objects into ST_ASIO_OBJECT_SHARD_NUM shards by their ids, each shard has its own container and mutex,
+//so adding, deleting and finding objects in different shards will not block each other. with huge number of objects and frequent
+//connecting/disconnecting, set this macro to a value about the number of service threads (or bigger).
+#ifndef ST_ASIO_OBJECT_SHARD_NUM
+#define ST_ASIO_OBJECT_SHARD_NUM	1
+#elif ST_ASIO_OBJECT_SHARD_NUM <= 0
+	#error object shard number must be bigger than zero.
+#endif
+
 //define ST_ASIO_REUSE_OBJECT macro will enable object pool, all objects in invalid_object_can will never be freed, but kept for reusing,
 //otherwise, st_object_pool will free objects in invalid_object_can automatically and periodically, ST_ASIO_FREE_OBJECT_INTERVAL means the interval, unit is second,
 //see invalid_object_can at the end of st_object_pool class for more details.
@@ -38,6 +48,15 @@
 	#elif ST_ASIO_FREE_OBJECT_INTERVAL <= 0
 		#error free object interval must be bigger than zero.
 	#endif
+#else
+	//with object pool, st_object_pool moves an object from invalid_object_can to ready_object_can right after it been closed (see st_socket::close_callback),
+	//then reuse_object() just pops the first one from ready_object_can. objects which were not reusable at that time (for example, still referenced
+	//by others) will be moved periodically, ST_ASIO_READY_OBJECT_INTERVAL means the interval, unit is second.
+	#ifndef ST_ASIO_READY_OBJECT_INTERVAL
+	#define ST_ASIO_READY_OBJECT_INTERVAL	60 //seconds
+	#elif ST_ASIO_READY_OBJECT_INTERVAL <= 0
+		#error ready object interval must be bigger than zero.
+	#endif
 #endif
 
 //define ST_ASIO_CLEAR_OBJECT_INTERVAL macro to let st_object_pool to invoke clear_obsoleted_object() automatically and periodically
@@ -52,30 +71,7 @@
 namespace st_asio_wrapper
 {
 
-#if BOOST_VERSION >= 105300
-typedef boost::atomic_uint_fast64_t st_atomic_uint_fast64;
-#else
-template <typename T>
-class st_atomic
-{
-public:
-	st_atomic() : data(0) {}
-	st_atomic(const T& _data) : data(_data) {}
-	T operator++() {boost::unique_lock<boost::shared_mutex> lock(data_mutex); return ++data;}
-	//deliberately omitted operator++(int)
-	T operator+=(const T& value) {boost::unique_lock<boost::shared_mutex> lock(data_mutex); return data += value;}
-	T operator--() {boost::unique_lock<boost::shared_mutex> lock(data_mutex); return --data;}
-	//deliberately omitted operator--(int)
-	T operator-=(const T& value) {boost::unique_lock<boost::shared_mutex> lock(data_mutex); return data -= value;}
-	T operator=(const T& value) {boost::unique_lock<boost::shared_mutex> lock(data_mutex); return data = value;}
-	operator T() const {return data;}
-
-private:
-	T data;
-	boost::shared_mutex data_mutex;
-};
 typedef st_atomic<boost::uint_fast64_t> st_atomic_uint_fast64;
-#endif
 
 template<typename Object>
 class st_object_pool : public st_service_pump::i_service, protected st_timer
@@ -84,6 +80,14 @@ public:
 	typedef boost::shared_ptr<Object> object_type;
 	typedef const object_type object_ctype;
 
+	//an immutable copy of all objects in the pool, see get_snapshot().
+	struct object_snapshot
+	{
+		boost::uint_fast64_t version;
+		std::vector<object_type> objects;
+	};
+	typedef boost::shared_ptr<const object_snapshot> snapshot_type;
+
 protected:
 	struct st_object_hasher : public std::unary_function<object_type, size_t>
 	{
@@ -101,10 +105,19 @@ protected:
 
 	typedef boost::unordered::unordered_set<object_type, st_object_hasher, st_object_equal> container_type;
 
+	struct object_shard
+	{
+		container_type object_can;
+		boost::shared_mutex object_can_mutex;
+	};
+
+	object_shard& shard_of(boost::uint_fast64_t id) {return shards[id % ST_ASIO_OBJECT_SHARD_NUM];}
+
 protected:
 	static const tid TIMER_BEGIN = st_timer::TIMER_END;
 	static const tid TIMER_FREE_SOCKET = TIMER_BEGIN;
 	static const tid TIMER_CLEAR_SOCKET = TIMER_BEGIN + 1;
+	static const tid TIMER_READY_SOCKET = TIMER_BEGIN + 2;
 	static const tid TIMER_END = TIMER_BEGIN + 10;
 
 	st_object_pool(st_service_pump& service_pump_) : i_service(service_pump_), st_timer(service_pump_), cur_id(-1), max_size_(ST_ASIO_MAX_OBJECT_NUM) {}
@@ -113,6 +126,8 @@ protected:
 	{
 #ifndef ST_ASIO_REUSE_OBJECT
 		set_timer(TIMER_FREE_SOCKET, 1000 * ST_ASIO_FREE_OBJECT_INTERVAL, boost::bind(&st_object_pool::free_object_handler, this, _1));
+#else
+		set_timer(TIMER_READY_SOCKET, 1000 * ST_ASIO_READY_OBJECT_INTERVAL, boost::bind(&st_object_pool::prepare_ready_object_handler, this, _1));
 #endif
 #ifdef ST_ASIO_CLEAR_OBJECT_INTERVAL
 		set_timer(TIMER_CLEAR_SOCKET, 1000 * ST_ASIO_CLEAR_OBJECT_INTERVAL, boost::bind(&st_object_pool::clear_obsoleted_object_handler, this, _1));
@@ -125,30 +140,65 @@ protected:
 	{
 		assert(object_ptr);
 
-		boost::unique_lock<boost::shared_mutex> lock(object_can_mutex);
-		return object_can.size() < max_size_ ? object_can.insert(object_ptr).second : false;
+		if (++object_num > max_size_)
+		{
+			--object_num;
+			return false;
+		}
+
+		BOOST_AUTO(&shard, shard_of(object_ptr->id()));
+		boost::unique_lock<boost::shared_mutex> lock(shard.object_can_mutex);
+		bool re = shard.object_can.insert(object_ptr).second;
+		lock.unlock();
+
+		if (re)
+		{
+			++membership_version;
+			sp.inc_io_service_load(object_ptr->get_io_service());
+#ifdef ST_ASIO_REUSE_OBJECT
+			//don't hold object_ptr, or it will never be unique
+			object_ptr->close_callback(boost::bind(&st_object_pool::object_close_handler, this, object_ptr.get()));
+#endif
+		}
+		else
+			--object_num;
+
+		return re;
 	}
 
-	//only add object_ptr to invalid_object_can when it's in object_can, this can avoid duplicated items in invalid_object_can, because invalid_object_can is a list,
-	//there's no way to check the existence of an item in a list efficiently.
+	//only add object_ptr to invalid_object_can when it's in object_can, this can avoid duplicated items in invalid_object_can.
 	bool del_object(object_ctype& object_ptr)
 	{
 		assert(object_ptr);
 
-		boost::unique_lock<boost::shared_mutex> lock(object_can_mutex);
-		bool exist = object_can.erase(object_ptr) > 0;
+		BOOST_AUTO(&shard, shard_of(object_ptr->id()));
+		boost::unique_lock<boost::shared_mutex> lock(shard.object_can_mutex);
+		bool exist = shard.object_can.erase(object_ptr) > 0;
 		lock.unlock();
 
 		if (exist)
 		{
+			--object_num;
+			++membership_version;
+			drop_snapshot();
+			sp.dec_io_service_load(object_ptr->get_io_service());
+
 			boost::unique_lock<boost::shared_mutex> lock(invalid_object_can_mutex);
-			invalid_object_can.push_back(object_ptr);
+			invalid_object_can.insert(object_ptr);
+#ifdef ST_ASIO_REUSE_OBJECT
+			lock.unlock();
+
+			if (!object_ptr->started()) //closed (or closing) before been deleted, the close callback may have found nothing
+				post_ready_object(object_ptr->id());
+#endif
 		}
 
 		return exist;
 	}
 
 	virtual void on_create(object_ctype& object_ptr) {}
+	//invoked by clear_obsoleted_object() for each object it kicked out
+	virtual void on_kick_out(object_ctype& object_ptr) {}
 
 	void init_object(object_ctype& object_ptr)
 	{
@@ -162,23 +212,83 @@ protected:
 	}
 
 #ifdef ST_ASIO_REUSE_OBJECT
+	//O(1) unless somebody got objects in ready_object_can via invalid_object_find() or invalid_object_at() and still holds them.
 	object_type reuse_object()
 	{
-		boost::unique_lock<boost::shared_mutex> lock(invalid_object_can_mutex);
-		for (BOOST_AUTO(iter, invalid_object_can.begin()); iter != invalid_object_can.end(); ++iter)
-			if ((*iter).unique() && (*iter)->obsoleted())
+		boost::unique_lock<boost::shared_mutex> lock(ready_object_can_mutex);
+		while (!ready_object_can.empty())
+		{
+			object_type object_ptr;
+			object_ptr.swap(ready_object_can.front());
+			ready_object_can.pop_front();
+			if (object_ptr.unique() && object_ptr->obsoleted())
 			{
-				BOOST_AUTO(object_ptr, *iter);
-				invalid_object_can.erase(iter);
 				lock.unlock();
 
 				object_ptr->reset();
 				return object_ptr;
 			}
 
+			//not reusable anymore, give it back to invalid_object_can
+			boost::unique_lock<boost::shared_mutex> invalid_lock(invalid_object_can_mutex);
+			invalid_object_can.insert(object_ptr);
+		}
+
 		return object_type();
 	}
 
+	//move the object from invalid_object_can to ready_object_can if it's reusable, the object just been closed or deleted, O(1).
+	//it's invoked by the close callback directly, and via post by del_object() (the deleter still holds the object).
+	//an object in its last async call (the close callback) is treated as reusable, because returning only takes a moment,
+	//if reuse_object() meets it within that moment, it will be given back to invalid_object_can and wait for prepare_ready_object().
+	//return true if the object been moved.
+	bool prepare_ready_object(boost::uint_fast64_t id)
+	{
+		boost::unique_lock<boost::shared_mutex> lock(invalid_object_can_mutex);
+		BOOST_AUTO(iter, invalid_object_can.find(id, st_object_hasher(), st_object_equal()));
+		if (iter == invalid_object_can.end() || !(*iter).unique())
+			return false;
+		else if (!(*iter)->obsoleted() && ((*iter)->started() || !(*iter)->is_async_calling() || !(*iter)->is_last_async_call()))
+			return false;
+
+		object_type object_ptr(*iter);
+		invalid_object_can.erase(iter);
+		lock.unlock();
+
+		boost::unique_lock<boost::shared_mutex> ready_lock(ready_object_can_mutex);
+		ready_object_can.push_back(object_ptr);
+		return true;
+	}
+	void post_ready_object(boost::uint_fast64_t id)
+		{post(boost::bind((bool (st_object_pool::*)(boost::uint_fast64_t)) &st_object_pool::prepare_ready_object, this, id));}
+
+	//move all reusable objects from invalid_object_can to ready_object_can, st_object_pool invokes this periodically, see ST_ASIO_READY_OBJECT_INTERVAL.
+	//objects are appended to ready_object_can in the order they became ready, so the ones been waiting longest will be reused first.
+	size_t prepare_ready_object()
+	{
+		BOOST_TYPEOF(ready_object_can) objects;
+
+		boost::unique_lock<boost::shared_mutex> lock(invalid_object_can_mutex);
+		for (BOOST_AUTO(iter, invalid_object_can.begin()); iter != invalid_object_can.end();)
+			if ((*iter).unique() && (*iter)->obsoleted())
+			{
+				objects.push_back(*iter);
+				iter = invalid_object_can.erase(iter);
+			}
+			else
+				++iter;
+		lock.unlock();
+
+		size_t size = objects.size();
+		if (0 != size)
+		{
+			boost::unique_lock<boost::shared_mutex> lock(ready_object_can_mutex);
+			ready_object_can.splice(ready_object_can.end(), objects);
+		}
+
+		return size;
+	}
+
 	template<typename Arg>
 	object_type create_object(Arg& arg)
 	{
@@ -218,70 +328,97 @@ protected:
 	}
 #endif
 
-	object_type create_object() {return create_object(boost::ref(sp));}
+	//with ST_ASIO_IO_SERVICE_PER_THREAD, service pump will choose an io_service for the new object.
+	object_type create_object() {return create_object(boost::ref(sp.assign_io_service()));}
 
 public:
 	//to configure unordered_set(for example, set factor or reserved size), not locked the mutex, so must be called before service_pump starting up.
-	container_type& container() {return object_can;}
+	//index must be less than shard_num().
+	container_type& container(size_t index = 0) {assert(index < ST_ASIO_OBJECT_SHARD_NUM); return shards[index].object_can;}
+	size_t shard_num() const {return ST_ASIO_OBJECT_SHARD_NUM;}
 
 	size_t max_size() const {return max_size_;}
 	void max_size(size_t _max_size) {max_size_ = _max_size;}
 
-	size_t size()
-	{
-		boost::shared_lock<boost::shared_mutex> lock(object_can_mutex);
-		return object_can.size();
-	}
+	size_t size() {return object_num;}
 
+	//with object pool, objects in ready_object_can are counted in too, so do the following invalid_object_xxx functions.
 	size_t invalid_object_size()
 	{
 		boost::shared_lock<boost::shared_mutex> lock(invalid_object_can_mutex);
-		return invalid_object_can.size();
+		size_t size = invalid_object_can.size();
+#ifdef ST_ASIO_REUSE_OBJECT
+		lock.unlock();
+
+		boost::shared_lock<boost::shared_mutex> ready_lock(ready_object_can_mutex);
+		size += ready_object_can.size();
+#endif
+		return size;
 	}
 
 	object_type find(boost::uint_fast64_t id)
 	{
-		boost::shared_lock<boost::shared_mutex> lock(object_can_mutex);
-		BOOST_AUTO(iter, object_can.find(id, st_object_hasher(), st_object_equal()));
-		return iter != object_can.end() ? *iter : object_type();
+		BOOST_AUTO(&shard, shard_of(id));
+		boost::shared_lock<boost::shared_mutex> lock(shard.object_can_mutex);
+		BOOST_AUTO(iter, shard.object_can.find(id, st_object_hasher(), st_object_equal()));
+		return iter != shard.object_can.end() ? *iter : object_type();
 	}
 
 	//this method has linear complexity, please note.
 	object_type at(size_t index)
 	{
-		boost::shared_lock<boost::shared_mutex> lock(object_can_mutex);
-		assert(index < object_can.size());
-		return index < object_can.size() ? *(boost::next(object_can.begin(), index)) : object_type();
+		for (size_t i = 0; i < ST_ASIO_OBJECT_SHARD_NUM; ++i)
+		{
+			boost::shared_lock<boost::shared_mutex> lock(shards[i].object_can_mutex);
+			if (index < shards[i].object_can.size())
+				return *(boost::next(shards[i].object_can.begin(), index));
+
+			index -= shards[i].object_can.size();
+		}
+
+		assert(false);
+		return object_type();
 	}
 
 	//this method has linear complexity, please note.
 	object_type invalid_object_at(size_t index)
 	{
 		boost::shared_lock<boost::shared_mutex> lock(invalid_object_can_mutex);
-		assert(index < invalid_object_can.size());
-		return index < invalid_object_can.size() ? *boost::next(invalid_object_can.begin(), index) : object_type();
+		if (index < invalid_object_can.size())
+			return *boost::next(invalid_object_can.begin(), index);
+#ifdef ST_ASIO_REUSE_OBJECT
+		index -= invalid_object_can.size();
+		lock.unlock();
+
+		boost::shared_lock<boost::shared_mutex> ready_lock(ready_object_can_mutex);
+		if (index < ready_object_can.size())
+			return *boost::next(ready_object_can.begin(), index);
+#endif
+
+		assert(false);
+		return object_type();
 	}
 
 	//this method has linear complexity, please note.
 	object_type invalid_object_find(boost::uint_fast64_t id)
 	{
-		boost::shared_lock<boost::shared_mutex> lock(invalid_object_can_mutex);
-		BOOST_AUTO(iter, std::find_if(invalid_object_can.begin(), invalid_object_can.end(), boost::bind(&Object::is_equal_to, _1, id)));
-		return iter == invalid_object_can.end() ? object_type() : *iter;
+		BOOST_AUTO(object_ptr, find_object(invalid_object_can, invalid_object_can_mutex, id, false));
+#ifdef ST_ASIO_REUSE_OBJECT
+		if (!object_ptr)
+			object_ptr = find_object(ready_object_can, ready_object_can_mutex, id, false);
+#endif
+		return object_ptr;
 	}
 
 	//this method has linear complexity, please note.
 	object_type invalid_object_pop(boost::uint_fast64_t id)
 	{
-		boost::shared_lock<boost::shared_mutex> lock(invalid_object_can_mutex);
-		BOOST_AUTO(iter, std::find_if(invalid_object_can.begin(), invalid_object_can.end(), boost::bind(&Object::is_equal_to, _1, id)));
-		if (iter != invalid_object_can.end())
-		{
-			BOOST_AUTO(object_ptr, *iter);
-			invalid_object_can.erase(iter);
-			return object_ptr;
-		}
-		return object_type();
+		BOOST_AUTO(object_ptr, find_object(invalid_object_can, invalid_object_can_mutex, id, true));
+#ifdef ST_ASIO_REUSE_OBJECT
+		if (!object_ptr)
+			object_ptr = find_object(ready_object_can, ready_object_can_mutex, id, true);
+#endif
+		return object_ptr;
 	}
 
 	void list_all_object() {do_something_to_all(boost::bind(&Object::show_info, _1, "", ""));}
@@ -293,26 +430,48 @@ public:
 	//st_object_pool will automatically invoke this function if ST_ASIO_CLEAR_OBJECT_INTERVAL been defined
 	size_t clear_obsoleted_object()
 	{
-		BOOST_TYPEOF(invalid_object_can) objects;
+		std::vector<object_type> objects;
+
+		//objects in the cached snapshot have one more reference, let them pass the checking, because other threads can publish a new snapshot
+		//at any time (so dropping it here is useless), objects held by in-flight traversals will be kicked out next time.
+		//collect them before locking any shard, so the checking is O(1) per object.
+		snapshot_type snapshot_ptr = boost::atomic_load(&cached_snapshot);
+		boost::unordered::unordered_set<const Object*> pinned_objects;
+		if (snapshot_ptr)
+		{
+			pinned_objects.reserve(snapshot_ptr->objects.size());
+			for (BOOST_AUTO(iter, snapshot_ptr->objects.begin()); iter != snapshot_ptr->objects.end(); ++iter)
+				pinned_objects.insert(iter->get());
+		}
 
-		boost::unique_lock<boost::shared_mutex> lock(object_can_mutex);
-		for (BOOST_AUTO(iter, object_can.begin()); iter != object_can.end();)
-			if ((*iter).unique() && (*iter)->obsoleted())
-			{
-				objects.push_back(*iter);
-				iter = object_can.erase(iter);
-			}
-			else
-				++iter;
-		lock.unlock();
+		for (size_t i = 0; i < ST_ASIO_OBJECT_SHARD_NUM; ++i)
+		{
+			boost::unique_lock<boost::shared_mutex> lock(shards[i].object_can_mutex);
+			for (BOOST_AUTO(iter, shards[i].object_can.begin()); iter != shards[i].object_can.end();)
+				if ((*iter)->obsoleted() && (*iter).use_count() == (pinned_objects.count(iter->get()) > 0 ? 2 : 1))
+				{
+					objects.push_back(*iter);
+					iter = shards[i].object_can.erase(iter);
+				}
+				else
+					++iter;
+		}
 
 		size_t size = objects.size();
 		if (0 != size)
 		{
+			object_num -= size;
+			++membership_version;
+			drop_snapshot();
 			unified_out::warning_out(ST_ASIO_SF " object(s) been kicked out!", size);
+			for (BOOST_AUTO(iter, objects.begin()); iter != objects.end(); ++iter)
+			{
+				sp.dec_io_service_load((*iter)->get_io_service());
+				on_kick_out(*iter);
+			}
 
 			boost::unique_lock<boost::shared_mutex> lock(invalid_object_can_mutex);
-			invalid_object_can.splice(invalid_object_can.end(), objects);
+			invalid_object_can.insert(objects.begin(), objects.end());
 		}
 
 		return size;
@@ -326,31 +485,122 @@ public:
 	size_t free_object(size_t num = -1)
 	{
 		size_t num_affected = 0;
+#ifdef ST_ASIO_REUSE_OBJECT
+		num_affected += free_object(ready_object_can, ready_object_can_mutex, num);
+#endif
+		num_affected += free_object(invalid_object_can, invalid_object_can_mutex, num);
 
-		boost::unique_lock<boost::shared_mutex> lock(invalid_object_can_mutex);
-		for (BOOST_AUTO(iter, invalid_object_can.begin()); num > 0 && iter != invalid_object_can.end();)
+		if (num_affected > 0)
+			unified_out::warning_out(ST_ASIO_SF " object(s) been freed!", num_affected);
+
+		return num_affected;
+	}
+
+	//return all objects in the pool, the snapshot will be rebuilt only if objects been added or deleted since the last building,
+	//rebuilding locks shards one by one and only for copying shared pointers.
+	snapshot_type get_snapshot()
+	{
+		BOOST_AUTO(snapshot_ptr, boost::atomic_load(&cached_snapshot));
+		boost::uint_fast64_t version = membership_version; //fetch version before copying objects, then changes during copying will cause next rebuilding
+		if (snapshot_ptr && snapshot_ptr->version == version)
+			return snapshot_ptr;
+
+		BOOST_AUTO(new_snapshot_ptr, boost::make_shared<object_snapshot>());
+		new_snapshot_ptr->version = version;
+		new_snapshot_ptr->objects.reserve(object_num);
+		for (size_t i = 0; i < ST_ASIO_OBJECT_SHARD_NUM; ++i)
+		{
+			boost::shared_lock<boost::shared_mutex> lock(shards[i].object_can_mutex);
+			new_snapshot_ptr->objects.insert(new_snapshot_ptr->objects.end(), shards[i].object_can.begin(), shards[i].object_can.end());
+		}
+
+		snapshot_ptr = new_snapshot_ptr;
+		boost::atomic_store(&cached_snapshot, snapshot_ptr);
+		//if objects been added or deleted since we fetched the version, withdraw the snapshot (unless others already replaced it), because del_object
+		//may have dropped the cached snapshot before we published ours, then the deleted object would be pinned by ours.
+		//if the version changes after this checking, the changer will drop our snapshot itself (del_object) or cause next rebuilding (add_object).
+		if (version != membership_version)
+		{
+			snapshot_type expected(snapshot_ptr);
+			boost::atomic_compare_exchange(&cached_snapshot, &expected, snapshot_type());
+		}
+
+		return snapshot_ptr;
+	}
+
+	//traverse a snapshot without holding any locks, so adding and deleting objects (accepting and disconnecting) will not be blocked by broadcasting,
+	//but objects added or deleted during the traversal may or may not be visited.
+	template<typename _Predicate> void do_something_to_all(const _Predicate& __pred)
+	{
+		BOOST_AUTO(snapshot_ptr, get_snapshot());
+		for (BOOST_AUTO(iter, snapshot_ptr->objects.begin()); iter != snapshot_ptr->objects.end(); ++iter)
+			__pred(*iter);
+	}
+
+	template<typename _Predicate> void do_something_to_one(const _Predicate& __pred)
+	{
+		BOOST_AUTO(snapshot_ptr, get_snapshot());
+		for (BOOST_AUTO(iter, snapshot_ptr->objects.begin()); iter != snapshot_ptr->objects.end(); ++iter)
+			if (__pred(*iter))
+				break;
+	}
+
+private:
+	//the cached snapshot holds all objects in it, release them to let deleted objects become unique (so can be reused or freed).
+	void drop_snapshot() {boost::atomic_store(&cached_snapshot, snapshot_type());}
+
+	object_type find_object(container_type& can, boost::shared_mutex& can_mutex, boost::uint_fast64_t id, bool pop)
+	{
+		boost::unique_lock<boost::shared_mutex> lock(can_mutex);
+		BOOST_AUTO(iter, can.find(id, st_object_hasher(), st_object_equal()));
+		if (iter == can.end())
+			return object_type();
+
+		object_type object_ptr(*iter);
+		if (pop)
+			can.erase(iter);
+		return object_ptr;
+	}
+
+	object_type find_object(boost::container::list<object_type>& can, boost::shared_mutex& can_mutex, boost::uint_fast64_t id, bool pop)
+	{
+		boost::unique_lock<boost::shared_mutex> lock(can_mutex);
+		BOOST_AUTO(iter, std::find_if(can.begin(), can.end(), boost::bind(&Object::is_equal_to, _1, id)));
+		if (iter == can.end())
+			return object_type();
+		else if (!pop)
+			return *iter;
+
+		BOOST_AUTO(object_ptr, *iter);
+		can.erase(iter);
+		return object_ptr;
+	}
+
+	//num will be decreased by the returned value
+	template<typename Can>
+	size_t free_object(Can& can, boost::shared_mutex& can_mutex, size_t& num)
+	{
+		size_t num_affected = 0;
+
+		boost::unique_lock<boost::shared_mutex> lock(can_mutex);
+		for (BOOST_AUTO(iter, can.begin()); num > 0 && iter != can.end();)
 			if ((*iter).unique() && (*iter)->obsoleted())
 			{
 				--num;
 				++num_affected;
-				iter = invalid_object_can.erase(iter);
+				iter = can.erase(iter);
 			}
 			else
 				++iter;
-		lock.unlock();
-
-		if (num_affected > 0)
-			unified_out::warning_out(ST_ASIO_SF " object(s) been freed!", num_affected);
 
 		return num_affected;
 	}
 
-	DO_SOMETHING_TO_ALL_MUTEX(object_can, object_can_mutex)
-	DO_SOMETHING_TO_ONE_MUTEX(object_can, object_can_mutex)
-
-private:
 #ifndef ST_ASIO_REUSE_OBJECT
 	bool free_object_handler(tid id) {assert(TIMER_FREE_SOCKET == id); free_object(); return true;}
+#else
+	bool prepare_ready_object_handler(tid id) {assert(TIMER_READY_SOCKET == id); prepare_ready_object(); return true;}
+	void object_close_handler(const Object* object_ptr) {prepare_ready_object(object_ptr->id());} //the close callback, see add_object()
 #endif
 
 #ifdef ST_ASIO_CLEAR_OBJECT_INTERVAL
@@ -360,17 +610,26 @@ private:
 protected:
 	st_atomic_uint_fast64 cur_id;
 
-	container_type object_can;
-	boost::shared_mutex object_can_mutex;
+	object_shard shards[ST_ASIO_OBJECT_SHARD_NUM];
+	st_atomic<size_t> object_num; //objects in all shards
+	st_atomic_uint_fast64 membership_version; //increased when objects been added into or deleted from shards
+	snapshot_type cached_snapshot; //only accessed via boost::atomic_load and boost::atomic_store
 	size_t max_size_;
 
-	//because all objects are dynamic created and stored in object_can, maybe when receiving error occur
+	//because all objects are dynamic created and stored in object_can (of all shards), maybe when receiving error occur
 	//(you are recommended to delete the object from object_can, for example via st_server_base::del_client), some other asynchronous calls are still queued in boost::asio::io_service,
 	//and will be dequeued in the future, we must guarantee these objects not be freed from the heap or reused, so we move these objects from object_can to invalid_object_can,
 	//and free them from the heap or reuse them in the near future.
 	//if ST_ASIO_CLEAR_OBJECT_INTERVAL been defined, clear_obsoleted_object() will be invoked automatically and periodically to move all invalid objects into invalid_object_can.
-	boost::container::list<object_type> invalid_object_can;
+	//it's keyed by id as object_can, so an object just been closed can be found in constant time (see prepare_ready_object(boost::uint_fast64_t)).
+	container_type invalid_object_can;
 	boost::shared_mutex invalid_object_can_mutex;
+
+#ifdef ST_ASIO_REUSE_OBJECT
+	//objects moved from invalid_object_can by prepare_ready_object(), they are (almost always) reusable, so reuse_object() needs not to search them.
+	boost::container::list<object_type> ready_object_can;
+	boost::shared_mutex ready_object_can_mutex;
+#endif
 };
 
 } //namespace
@@ -32,9 +32,10 @@ public:
 	static const st_timer::tid TIMER_ASYNC_SHUTDOWN = TIMER_BEGIN;
 	static const st_timer::tid TIMER_END = TIMER_BEGIN + 10;
 
-	st_server_socket_base(Server& server_) : super(server_.get_service_pump()), server(server_) {}
+	//with ST_ASIO_IO_SERVICE_PER_THREAD, accepted sockets will be bound to the io_service chosen by service pump, not the acceptor's
+	st_server_socket_base(Server& server_) : super(server_.get_service_pump().assign_io_service()), server(server_) {}
 	template<typename Arg>
-	st_server_socket_base(Server& server_, Arg& arg) : super(server_.get_service_pump(), arg), server(server_) {}
+	st_server_socket_base(Server& server_, Arg& arg) : super(server_.get_service_pump().assign_io_service(), arg), server(server_) {}
 
 	//reset all, be ensure that there's no any operations performed on this socket when invoke it
 	//please note, when reuse this socket, st_object_pool will invoke reset(), child must re-write it to initialize all member variables,
@@ -33,6 +33,64 @@
 	#endif
 #endif
 
+//if receiving has been suspended by handle_msg() because of recv buffer been full, it will be resumed as soon as the number of msgs
+//in recv buffer drops below this value.
+#ifndef ST_ASIO_RECV_BUFFER_LOW_WATERMARK
+#define ST_ASIO_RECV_BUFFER_LOW_WATERMARK	(ST_ASIO_MAX_MSG_NUM / 2 + 1)
+#elif ST_ASIO_RECV_BUFFER_LOW_WATERMARK <= 0 || ST_ASIO_RECV_BUFFER_LOW_WATERMARK > ST_ASIO_MAX_MSG_NUM
+	#error ST_ASIO_RECV_BUFFER_LOW_WATERMARK must be bigger than zero and not bigger than ST_ASIO_MAX_MSG_NUM.
+#endif
+
+//after the send buffer been full (see ST_ASIO_SEND_BUFFER_HIGH_BYTES), on_send_buffer_low() will be invoked only after the number of msgs in it drops
+//below this value (and the bytes drop to the low watermark), this doesn't affect send_msg, see is_send_buffer_available().
+#ifndef ST_ASIO_SEND_BUFFER_LOW_WATERMARK
+#define ST_ASIO_SEND_BUFFER_LOW_WATERMARK	(ST_ASIO_MAX_MSG_NUM / 2 + 1)
+#elif ST_ASIO_SEND_BUFFER_LOW_WATERMARK <= 0 || ST_ASIO_SEND_BUFFER_LOW_WATERMARK > ST_ASIO_MAX_MSG_NUM
+	#error ST_ASIO_SEND_BUFFER_LOW_WATERMARK must be bigger than zero and not bigger than ST_ASIO_MAX_MSG_NUM.
+#endif
+
+//byte based limits of send and recv buffers (the sum of msgs' size), they work together with the msg number limit (ST_ASIO_MAX_MSG_NUM),
+//so you can define ST_ASIO_MAX_MSG_NUM to a big value and limit memory usage by bytes if msgs' size varies a lot.
+//send buffer refuses new msgs (unless can_overflow is true) after its bytes reached the high watermark, until they dropped to the low watermark.
+//receiving will be suspended after the bytes in recv buffer reached the high watermark, and resumed after they dropped to the low watermark.
+//these are default values, they can be changed at runtime for each st_socket, see send_buffer_watermark() and recv_buffer_watermark().
+//low watermarks must not be bigger than high watermarks.
+#ifndef ST_ASIO_SEND_BUFFER_HIGH_BYTES
+#define ST_ASIO_SEND_BUFFER_HIGH_BYTES	((size_t) ST_ASIO_MAX_MSG_NUM * ST_ASIO_MSG_BUFFER_SIZE)
+#endif
+#ifndef ST_ASIO_SEND_BUFFER_LOW_BYTES
+#define ST_ASIO_SEND_BUFFER_LOW_BYTES	(ST_ASIO_SEND_BUFFER_HIGH_BYTES / 2)
+#endif
+
+#ifndef ST_ASIO_RECV_BUFFER_HIGH_BYTES
+#define ST_ASIO_RECV_BUFFER_HIGH_BYTES	((size_t) ST_ASIO_MAX_MSG_NUM * ST_ASIO_MSG_BUFFER_SIZE)
+#endif
+#ifndef ST_ASIO_RECV_BUFFER_LOW_BYTES
+#define ST_ASIO_RECV_BUFFER_LOW_BYTES	(ST_ASIO_RECV_BUFFER_HIGH_BYTES / 2)
+#endif
+
+//after on_msg_handle() returned false, st_socket will re-dispatch the msg according to the re-dispatch policy (see st_socket::redispatch_policies),
+//with REDISPATCH_BACKOFF, the delay begins from ST_ASIO_MIN_REDISPATCH_INTERVAL, and doubles after each failure until ST_ASIO_MAX_REDISPATCH_INTERVAL,
+//it goes back to ST_ASIO_MIN_REDISPATCH_INTERVAL once a msg been handled successfully. unit is millisecond.
+//define ST_ASIO_MAX_REDISPATCH_INTERVAL bigger than ST_ASIO_MIN_REDISPATCH_INTERVAL to get an exponential backoff.
+#ifndef ST_ASIO_MIN_REDISPATCH_INTERVAL
+#define ST_ASIO_MIN_REDISPATCH_INTERVAL	50
+#elif ST_ASIO_MIN_REDISPATCH_INTERVAL <= 0
+	#error ST_ASIO_MIN_REDISPATCH_INTERVAL must be bigger than zero.
+#endif
+#ifndef ST_ASIO_MAX_REDISPATCH_INTERVAL
+#define ST_ASIO_MAX_REDISPATCH_INTERVAL	ST_ASIO_MIN_REDISPATCH_INTERVAL
+#elif ST_ASIO_MAX_REDISPATCH_INTERVAL < ST_ASIO_MIN_REDISPATCH_INTERVAL
+	#error ST_ASIO_MAX_REDISPATCH_INTERVAL must not be smaller than ST_ASIO_MIN_REDISPATCH_INTERVAL.
+#endif
+
+//dispatch msgs in batches, at most this amount of msgs will be fetched from recv buffer in one lock acquisition and dispatched by one io_service::post,
+//see st_socket::on_msg_handle_batch for more details. you must define this macro as a value, not just define it.
+//if this macro not defined, msgs will be dispatched one by one via on_msg_handle().
+#if defined(ST_ASIO_DISPATCH_BATCH_MSG) && ST_ASIO_DISPATCH_BATCH_MSG <= 0
+	#error ST_ASIO_DISPATCH_BATCH_MSG must be bigger than zero.
+#endif
+
 namespace st_asio_wrapper
 {
 
@@ -46,16 +104,27 @@ protected:
 	typedef obj_with_begin_time<OutMsgType> out_msg;
 	typedef InQueue<in_msg, InContainer<in_msg> > in_container_type;
 	typedef OutQueue<out_msg, OutContainer<out_msg> > out_container_type;
+	typedef boost::container::list<out_msg> out_batch_type; //see on_msg_handle_batch
 
 	static const tid TIMER_BEGIN = st_timer::TIMER_END;
-	static const tid TIMER_HANDLE_MSG = TIMER_BEGIN;
+	static const tid TIMER_HANDLE_MSG = TIMER_BEGIN; //not used anymore (see resume_recv_msg), just keeps ids of the followings unchanged
 	static const tid TIMER_DISPATCH_MSG = TIMER_BEGIN + 1;
 	static const tid TIMER_DELAY_CLOSE = TIMER_BEGIN + 2;
 	static const tid TIMER_END = TIMER_BEGIN + 10;
 
-	st_socket(boost::asio::io_service& io_service_) : st_timer(io_service_), _id(-1), next_layer_(io_service_), packer_(boost::make_shared<Packer>()), started_(false) {reset_state();}
+	st_socket(boost::asio::io_service& io_service_) : st_timer(io_service_), _id(-1), next_layer_(io_service_),
+#ifndef ST_ASIO_STATIC_PACKER
+		packer_(boost::make_shared<Packer>()),
+#endif
+		redispatch_policy_(REDISPATCH_BACKOFF), send_high_bytes(ST_ASIO_SEND_BUFFER_HIGH_BYTES), send_low_bytes(ST_ASIO_SEND_BUFFER_LOW_BYTES), recv_high_bytes(ST_ASIO_RECV_BUFFER_HIGH_BYTES),
+		recv_low_bytes(ST_ASIO_RECV_BUFFER_LOW_BYTES), started_(false) {reset_state();}
 	template<typename Arg>
-	st_socket(boost::asio::io_service& io_service_, Arg& arg) : st_timer(io_service_), _id(-1), next_layer_(io_service_, arg), packer_(boost::make_shared<Packer>()), started_(false) {reset_state();}
+	st_socket(boost::asio::io_service& io_service_, Arg& arg) : st_timer(io_service_), _id(-1), next_layer_(io_service_, arg),
+#ifndef ST_ASIO_STATIC_PACKER
+		packer_(boost::make_shared<Packer>()),
+#endif
+		redispatch_policy_(REDISPATCH_BACKOFF), send_high_bytes(ST_ASIO_SEND_BUFFER_HIGH_BYTES), send_low_bytes(ST_ASIO_SEND_BUFFER_LOW_BYTES), recv_high_bytes(ST_ASIO_RECV_BUFFER_HIGH_BYTES),
+		recv_low_bytes(ST_ASIO_RECV_BUFFER_LOW_BYTES), started_(false) {reset_state();}
 
 	void reset()
 	{
@@ -70,21 +139,34 @@ protected:
 	{
 		packer_->reset_state();
 
-		sending = paused_sending = false;
-		dispatching = paused_dispatching = congestion_controlling = false;
+		send_state.fetch_and(SEND_BUFFER_FULL); //see clear_buffer()
+		recv_state = 0;
+		redispatch_state = next_wait(redispatch_state); //ignore expirations of TIMER_DISPATCH_MSG set before resetting
+		redispatch_interval = ST_ASIO_MIN_REDISPATCH_INTERVAL;
 #ifndef ST_ASIO_ENHANCED_STABILITY
 		closing = false;
 #endif
 //		started_ = false;
 	}
 
+	//it's part of resetting (the send buffer's full state is dropped without invoking on_send_buffer_low(), and handlers registered by
+	//async_wait_writable() are discarded without been invoked), because they belong to the previous link, so reset your own states in reset() too.
 	void clear_buffer()
 	{
 		send_msg_buffer.clear();
 		recv_msg_buffer.clear();
 		temp_msg_buffer.clear();
+		overflow_msg_buffer.clear();
 
+#ifndef ST_ASIO_DISPATCH_BATCH_MSG
 		last_dispatch_msg.clear();
+#else
+		last_dispatch_msgs.clear();
+#endif
+
+		send_state.fetch_and((unsigned char) ~SEND_BUFFER_FULL);
+		boost::lock_guard<boost::mutex> lock(writable_handlers_mutex);
+		writable_handlers.clear();
 	}
 
 public:
@@ -108,6 +190,10 @@ public:
 #endif
 	}
 
+	//st_object_pool (with ST_ASIO_REUSE_OBJECT) sets this to know when this st_socket been closed, it's invoked right after on_close(),
+	//so st_object_pool can reuse this st_socket as soon as possible.
+	void close_callback(const boost::function<void()>& handler) {close_callback_ = handler;}
+
 	bool started() const {return started_;}
 	void start()
 	{
@@ -119,43 +205,150 @@ public:
 	//return false if send buffer is empty or sending not allowed or io_service stopped
 	bool send_msg()
 	{
-		if (!sending)
+		while (claim_state(send_state, SENDING, SEND_PAUSED))
 		{
-			boost::unique_lock<boost::shared_mutex> lock(send_mutex);
-			if (!sending)
-			{
-				sending = true;
-				lock.unlock();
+			if (do_send_msg())
+				return true;
 
-				if (!do_send_msg())
-					sending = false;
-			}
+			//msgs can be put into send buffer after do_send_msg() checked it and before SENDING been cleared, their senders found
+			//that we were sending, so nobody will send them, check send buffer again after SENDING been cleared.
+			if (end_sending() & SEND_PAUSED || send_msg_buffer.empty() || !is_send_allowed() || stopped())
+				break;
 		}
 
-		return sending;
+		return 0 != (send_state.load() & SENDING);
 	}
 
-	void suspend_send_msg(bool suspend) {if (!(paused_sending = suspend)) send_msg();}
-	bool suspend_send_msg() const {return paused_sending;}
+	void suspend_send_msg(bool suspend)
+	{
+		if (suspend)
+			send_state.fetch_or(SEND_PAUSED);
+		else
+		{
+			send_state.fetch_and((unsigned char) ~SEND_PAUSED);
+			send_msg();
+		}
+	}
+	bool suspend_send_msg() const {return 0 != (send_state.load() & SEND_PAUSED);}
+
+	void suspend_dispatch_msg(bool suspend)
+	{
+		if (suspend)
+			recv_state.fetch_or(DISPATCH_PAUSED);
+		else
+		{
+			recv_state.fetch_and((unsigned char) ~DISPATCH_PAUSED);
+			dispatch_msg();
+			resume_recv_msg();
+		}
+	}
+	bool suspend_dispatch_msg() const {return 0 != (recv_state.load() & DISPATCH_PAUSED);}
+
+	//how to re-dispatch the msg after on_msg_handle() returned false:
+	// REDISPATCH_IMMEDIATELY, re-dispatch it at once, for handlers which are only busy for a very short time;
+	// REDISPATCH_BACKOFF, re-dispatch it after a delay (see ST_ASIO_MIN_REDISPATCH_INTERVAL and ST_ASIO_MAX_REDISPATCH_INTERVAL), this is the default policy;
+	// REDISPATCH_ON_NOTIFY, re-dispatch it after resume_dispatch_msg() been called.
+	//no matter which policy is used, subsequent msgs will not be dispatched before this msg been handled successfully, so the sequence is kept.
+	enum redispatch_policies {REDISPATCH_IMMEDIATELY, REDISPATCH_BACKOFF, REDISPATCH_ON_NOTIFY};
+	void redispatch_policy(redispatch_policies policy) {redispatch_policy_ = policy;}
+	redispatch_policies redispatch_policy() const {return redispatch_policy_;}
+
+	//re-dispatch the msg which on_msg_handle() refused right now, with REDISPATCH_BACKOFF, the rest of the delay will be skipped.
+	//if no msg is waiting for re-dispatching, this notification will be remembered and take effect on the next refused msg (if any),
+	//because on_msg_handle() may call this (or cause it to be called in other threads) before it returns false, then return false.
+	//the remembered notification will be forgotten once a msg been handled successfully, so it cannot skip the delay of a much later refused msg.
+	bool resume_dispatch_msg()
+	{
+		size_t state = redispatch_state;
+		while (DISPATCH_NOTIFIED != (state & DISPATCH_STATE_MASK))
+			if (DISPATCH_WAITING == (state & DISPATCH_STATE_MASK))
+			{
+				if (redispatch_state.compare_exchange_strong(state, next_wait(state)))
+				{
+					stop_timer(TIMER_DISPATCH_MSG); //must before re-dispatching, otherwise, we may stop the timer set for the next refused msg
+					continue_dispatching();
+					return true;
+				}
+			}
+			else if (redispatch_state.compare_exchange_strong(state, state | DISPATCH_NOTIFIED))
+				break;
 
-	void suspend_dispatch_msg(bool suspend) {if (!(paused_dispatching = suspend)) dispatch_msg();}
-	bool suspend_dispatch_msg() const {return paused_dispatching;}
+		return false;
+	}
 
-	void congestion_control(bool enable) {congestion_controlling = enable; unified_out::warning_out("%s congestion control.", enable ? "open" : "close");}
-	bool congestion_control() const {return congestion_controlling;}
+	void congestion_control(bool enable)
+	{
+		if (enable)
+			recv_state.fetch_or(CONGESTION_CONTROLLING);
+		else
+			recv_state.fetch_and((unsigned char) ~CONGESTION_CONTROLLING);
+		unified_out::warning_out("%s congestion control.", enable ? "open" : "close");
+		if (!enable)
+			resume_recv_msg();
+	}
+	bool congestion_control() const {return 0 != (recv_state.load() & CONGESTION_CONTROLLING);}
 
 	const struct statistic& get_statistic() const {return stat;}
 
+#ifdef ST_ASIO_STATIC_PACKER
+	//the packer is held by value and called without virtual dispatching, it can be configured but not changed at runtime
+	Packer& inner_packer() {return *packer_;}
+	const Packer& inner_packer() const {return *packer_;}
+#else
 	//get or change the packer at runtime
 	//changing packer at runtime is not thread-safe, please pay special attention
 	//we can resolve this defect via mutex, but i think it's not worth, because this feature is not frequently used
 	boost::shared_ptr<i_packer<typename Packer::msg_type> > inner_packer() {return packer_;}
 	boost::shared_ptr<const i_packer<typename Packer::msg_type> > inner_packer() const {return packer_;}
 	void inner_packer(const boost::shared_ptr<i_packer<typename Packer::msg_type> >& _packer_) {packer_ = _packer_;}
+#endif
 
 	//if you use can_overflow = true to invoke send_msg or send_native_msg, it will always succeed no matter the sending buffer is available or not,
 	//this can exhaust all virtual memory, please pay special attentions.
-	bool is_send_buffer_available() const {return send_msg_buffer.size() < ST_ASIO_MAX_MSG_NUM;}
+	//the send buffer is not available if it holds ST_ASIO_MAX_MSG_NUM msgs, or its bytes reached the high watermark and have not dropped to the
+	//low watermark yet (the SEND_BUFFER_FULL state, see update_send_buffer_state()). the msg number limit is not affected by
+	//ST_ASIO_SEND_BUFFER_LOW_WATERMARK, which only delays on_send_buffer_low() and async_wait_writable().
+	bool is_send_buffer_available() const
+	{
+		if (send_msg_buffer.size() >= ST_ASIO_MAX_MSG_NUM)
+			return false;
+
+		size_t bytes = send_msg_buffer.size_in_bytes();
+		return bytes < send_high_bytes && !(send_buffer_full() && bytes > send_low_bytes);
+	}
+
+	//invoke handler (via post) after the send buffer dropped to the low watermarks (see on_send_buffer_low()), if it's not full, handler will be
+	//posted immediately. for the future version, see st_asio_wrapper_future.h.
+	//this is the non-blocking alternative of safe_send_msg, producers can pause after send_msg returned false, and resume in handler.
+	//handlers which are still waiting will be dropped (without invocation) when this st_socket been reset or destroyed.
+	void async_wait_writable(const boost::function<void()>& handler)
+	{
+		boost::unique_lock<boost::mutex> lock(writable_handlers_mutex);
+		if (send_buffer_full())
+			writable_handlers.push_back(handler);
+		else
+		{
+			lock.unlock();
+			post(handler);
+		}
+	}
+
+	//byte based limits of send and recv buffers, see ST_ASIO_SEND_BUFFER_HIGH_BYTES and ST_ASIO_RECV_BUFFER_HIGH_BYTES for more details.
+	//low must not be bigger than high, new limits take effect on the next check.
+	void send_buffer_watermark(size_t high, size_t low) {assert(low <= high); send_high_bytes = high; send_low_bytes = std::min(low, high); update_send_buffer_state();}
+	size_t send_buffer_high_watermark() const {return send_high_bytes;}
+	size_t send_buffer_low_watermark() const {return send_low_bytes;}
+
+	void recv_buffer_watermark(size_t high, size_t low)
+	{
+		assert(low <= high);
+		recv_high_bytes = high;
+		recv_low_bytes = std::min(low, high);
+		if (recv_resumable())
+			resume_recv_msg();
+	}
+	size_t recv_buffer_high_watermark() const {return recv_high_bytes;}
+	size_t recv_buffer_low_watermark() const {return recv_low_bytes;}
 
 	//don't use the packer but insert into send buffer directly
 	bool direct_send_msg(const InMsgType& msg, bool can_overflow = false) {InMsgType unused(msg); return direct_send_msg(unused, can_overflow);}
@@ -166,12 +359,16 @@ public:
 	GET_PENDING_MSG_NUM(get_pending_send_msg_num, send_msg_buffer)
 	GET_PENDING_MSG_NUM(get_pending_recv_msg_num, recv_msg_buffer)
 
-	POP_FIRST_PENDING_MSG(pop_first_pending_send_msg, send_msg_buffer, InMsgType)
-	POP_FIRST_PENDING_MSG(pop_first_pending_recv_msg, recv_msg_buffer, OutMsgType)
+	//how many bytes (sum of msgs' size) waiting for sending or dispatching, msgs in temp_msg_buffer and overflow_msg_buffer are not counted.
+	GET_PENDING_MSG_BYTES(get_pending_send_bytes, send_msg_buffer)
+	GET_PENDING_MSG_BYTES(get_pending_recv_bytes, recv_msg_buffer)
+
+	void pop_first_pending_send_msg(InMsgType& msg) {do_pop_first_pending_send_msg(msg); update_send_buffer_state();}
+	void pop_first_pending_recv_msg(OutMsgType& msg) {do_pop_first_pending_recv_msg(msg); if (recv_resumable()) resume_recv_msg();}
 
 	//clear all pending msgs
-	POP_ALL_PENDING_MSG(pop_all_pending_send_msg, send_msg_buffer, in_container_type)
-	POP_ALL_PENDING_MSG(pop_all_pending_recv_msg, recv_msg_buffer, out_container_type)
+	void pop_all_pending_send_msg(in_container_type& msg_queue) {do_pop_all_pending_send_msg(msg_queue); update_send_buffer_state();}
+	void pop_all_pending_recv_msg(out_container_type& msg_queue) {do_pop_all_pending_recv_msg(msg_queue); if (recv_resumable()) resume_recv_msg();}
 
 protected:
 	virtual bool do_start() = 0;
@@ -179,7 +376,7 @@ protected:
 	virtual void do_recv_msg() = 0;
 
 	virtual bool is_closable() {return true;}
-	virtual bool is_send_allowed() {return !paused_sending;} //can send msg or not(just put into send buffer)
+	virtual bool is_send_allowed() {return !suspend_send_msg();} //can send msg or not(just put into send buffer)
 
 	//generally, you don't have to rewrite this to maintain the status of connections(TCP)
 	virtual void on_send_error(const boost::system::error_code& ec) {unified_out::error_out("send msg error (%d %s)", ec.value(), ec.message().data());}
@@ -190,6 +387,8 @@ protected:
 	//this means you can clean up any resource in this st_socket except this st_socket itself, because this st_socket maybe is being maintained by st_object_pool.
 	//if ST_ASIO_ENHANCED_STABILITY macro not defined, st_socket simply call this callback ST_ASIO_DELAY_CLOSE seconds later after link down, no any guarantees.
 	virtual void on_close() {unified_out::info_out("on_close()");}
+	//invoked right before the socket been closed (the link is already down), resources which depend on the socket can be released here.
+	virtual void on_closing() {}
 
 #ifndef ST_ASIO_FORCE_TO_USE_MSG_RECV_BUFFER
 	//if you want to use your own receive buffer, you can move the msg to your own receive buffer, then handle them as your own strategy(may be you'll need a msg dispatch thread),
@@ -211,6 +410,25 @@ protected:
 	//notice: the msg is unpacked, using inconstant is for the convenience of swapping
 	virtual bool on_msg_handle(OutMsgType& msg, bool link_down) = 0;
 
+#ifdef ST_ASIO_DISPATCH_BATCH_MSG
+	//at most ST_ASIO_DISPATCH_BATCH_MSG msgs will be dispatched in one invocation, they were fetched from recv buffer in one lock acquisition.
+	//handle msgs from the front of msg_can, return how many msgs have been handled, the rest cannot be handled right now, st_socket will re-dispatch them
+	//asynchronously (new msgs may be appended to them), please don't remove or reorder them, otherwise the sequence cannot be guaranteed.
+	//if link_down is true, the return value will be ignored, st_socket will not maintain these msgs anymore.
+	//the default implementation calls on_msg_handle() for each msg until it returns false, so you can define ST_ASIO_DISPATCH_BATCH_MSG to save
+	//the cost of locking and posting without rewriting your on_msg_handle().
+	//
+	//notice: msgs are unpacked, using inconstant is for the convenience of swapping
+	virtual size_t on_msg_handle_batch(out_batch_type& msg_can, bool link_down)
+	{
+		size_t num = 0;
+		for (BOOST_AUTO(iter, msg_can.begin()); iter != msg_can.end() && (on_msg_handle(*iter, link_down) || link_down); ++iter)
+			++num;
+
+		return num;
+	}
+#endif
+
 #ifdef ST_ASIO_WANT_MSG_SEND_NOTIFY
 	//one msg has sent to the kernel buffer, msg is the right msg
 	//notice: the msg is packed, using inconstant is for the convenience of swapping
@@ -222,6 +440,16 @@ protected:
 	virtual void on_all_msg_send(InMsgType& msg) {}
 #endif
 
+	//the send buffer became full (ST_ASIO_MAX_MSG_NUM msgs or the high watermark bytes), send_msg will fail (unless can_overflow is true),
+	//producers can pause at here until on_send_buffer_low() been invoked, instead of polling or sleeping (like safe_send_msg).
+	//these two callbacks are always invoked in pairs (high first, but clear_buffer() drops the full state without on_send_buffer_low(), see it) and
+	//never concurrently, but maybe in any thread (msg senders' threads or service threads). they are invoked with send_buffer_state_mutex (recursive)
+	//locked, sending msgs in them is fine, but do not block in them, especially do not wait for other threads which send msgs via this st_socket.
+	virtual void on_send_buffer_high() {}
+	//the send buffer dropped to the low watermarks (ST_ASIO_SEND_BUFFER_LOW_WATERMARK msgs and the low watermark bytes), it's available again.
+	//handlers registered by async_wait_writable will be posted after this invocation.
+	virtual void on_send_buffer_low() {}
+
 	//subclass notify st_socket the shutdown event.
 	void close()
 	{
@@ -238,62 +466,89 @@ protected:
 	//subclasses must guarantee not call this function in more than one thread concurrently.
 	void handle_msg()
 	{
-		BOOST_TYPEOF(temp_msg_buffer) temp_buffer;
 #ifndef ST_ASIO_FORCE_TO_USE_MSG_RECV_BUFFER
-		if (!temp_msg_buffer.empty() && !paused_dispatching && !congestion_controlling)
+		if (!temp_msg_buffer.empty() && !dispatch_blocked())
 		{
 			BOOST_AUTO(begin_time, statistic::local_time());
-			for (BOOST_AUTO(iter, temp_msg_buffer.begin()); !paused_dispatching && !congestion_controlling && iter != temp_msg_buffer.end();)
+			for (BOOST_AUTO(iter, temp_msg_buffer.begin()); !dispatch_blocked() && iter != temp_msg_buffer.end();)
 				if (on_msg(*iter))
 					temp_msg_buffer.erase(iter++);
 				else
-					temp_buffer.splice(temp_buffer.end(), temp_msg_buffer, iter++);
+					overflow_msg_buffer.splice(overflow_msg_buffer.end(), temp_msg_buffer, iter++);
 
 			stat.handle_time_1_sum += statistic::local_time() - begin_time;
 		}
 #else
-		temp_buffer.swap(temp_msg_buffer);
+		overflow_msg_buffer.splice(overflow_msg_buffer.end(), temp_msg_buffer);
 #endif
 
-		if (move_items_in(recv_msg_buffer, temp_buffer, -1) > 0)
+		if (move_items_in(recv_msg_buffer, overflow_msg_buffer, -1) > 0)
 			dispatch_msg();
 
-		if (temp_msg_buffer.empty() && recv_msg_buffer.size() < ST_ASIO_MAX_MSG_NUM)
+		if (temp_msg_buffer.empty() && overflow_msg_buffer.empty() && recv_msg_buffer.size() < ST_ASIO_MAX_MSG_NUM && recv_msg_buffer.size_in_bytes() < recv_high_bytes)
 			do_recv_msg(); //receive msg sequentially, which means second receiving only after first receiving success
 		else
 		{
+			//receiving will be resumed by resume_recv_msg() as soon as the cause disappeared (there's no polling), every place which
+			//makes recv_resumable() become true checks RECV_SUSPENDED and calls resume_recv_msg(): msg dispatching (dispatch_next_msg),
+			//suspend_dispatch_msg(false), congestion_control(false), recv_buffer_watermark() and pop_(first|all)_pending_recv_msg().
+			//recv_idle_begin_time must be set before RECV_SUSPENDED, because once RECV_SUSPENDED been set, handle_msg() can be invoked in other threads.
 			recv_idle_begin_time = statistic::local_time();
-			set_timer(TIMER_HANDLE_MSG, 50, boost::bind(&st_socket::timer_handler, this, _1));
+
+			recv_state.fetch_or(temp_msg_buffer.empty() ? RECV_SUSPENDED : RECV_SUSPENDED | ON_MSG_PENDING);
+			if (recv_resumable()) //the cause may have disappeared before RECV_SUSPENDED been set
+				resume_recv_msg();
 		}
 	}
 
+	//receiving suspended by handle_msg() can be resumed or not, handle_msg() will check it again after resumed.
+	//blocked dispatching only matters if msgs were left in temp_msg_buffer (on_msg() will not be invoked before it's unblocked), otherwise,
+	//receiving only waits for room in recv buffer, which can also be made by pop_(first|all)_pending_recv_msg() while dispatching is suspended.
+	bool recv_resumable() const
+	{
+		unsigned char state = recv_state.load();
+		return (0 == (state & ON_MSG_PENDING) || 0 == (state & (DISPATCH_PAUSED | CONGESTION_CONTROLLING))) &&
+			recv_msg_buffer.size() < ST_ASIO_RECV_BUFFER_LOW_WATERMARK && recv_msg_buffer.size_in_bytes() <= recv_low_bytes;
+	}
+
+	//if receiving has been suspended by handle_msg(), resume it (asynchronously),
+	//st_socket calls this automatically when msgs in recv buffer dropped below ST_ASIO_RECV_BUFFER_LOW_WATERMARK (and bytes dropped to the low watermark),
+	//suspend_dispatch_msg(false) been called or congestion_control(false) been called.
+	//return false if receiving was not suspended.
+	bool resume_recv_msg()
+	{
+		if (!claim_suspended_recv())
+			return false;
+
+		post(boost::bind(&st_socket::resume_handler, this));
+		return true;
+	}
+
 	//return false if receiving buffer is empty or dispatching not allowed or io_service stopped
 	bool dispatch_msg()
 	{
-		if (!dispatching)
+		while (claim_state(recv_state, DISPATCHING, DISPATCH_PAUSED))
 		{
-			boost::unique_lock<boost::shared_mutex> lock(dispatch_mutex);
-			if (!dispatching)
-			{
-				dispatching = true;
-				lock.unlock();
+			if (do_dispatch_msg())
+				return true;
 
-				if (!do_dispatch_msg())
-					dispatching = false;
-			}
+			//see send_msg() for more details
+			if (recv_state.fetch_and((unsigned char) ~DISPATCHING) & DISPATCH_PAUSED || recv_msg_buffer.empty() || stopped())
+				break;
 		}
 
-		return dispatching;
+		return 0 != (recv_state.load() & DISPATCHING);
 	}
 
 	//return false if receiving buffer is empty or dispatching not allowed or io_service stopped
 	bool do_dispatch_msg()
 	{
-		if (paused_dispatching)
+		if (suspend_dispatch_msg())
 			;
 		else if (stopped())
 		{
 #ifndef ST_ASIO_DISCARD_MSG_WHEN_LINK_DOWN
+	#ifndef ST_ASIO_DISPATCH_BATCH_MSG
 			if (!last_dispatch_msg.empty())
 			{
 				on_msg_handle(last_dispatch_msg, true);
@@ -304,9 +559,28 @@ protected:
 			typename out_container_type::lock_guard lock(recv_msg_buffer);
 			while (recv_msg_buffer.try_dequeue_(msg))
 				on_msg_handle(msg, true);
+	#else
+			out_msg msg;
+			typename out_container_type::lock_guard lock(recv_msg_buffer);
+			while (recv_msg_buffer.try_dequeue_(msg))
+			{
+				last_dispatch_msgs.resize(last_dispatch_msgs.size() + 1);
+				last_dispatch_msgs.back().swap(msg);
+			}
+
+			if (!last_dispatch_msgs.empty())
+			{
+				on_msg_handle_batch(last_dispatch_msgs, true);
+				last_dispatch_msgs.clear();
+			}
+	#endif
 #endif
 		}
+#ifndef ST_ASIO_DISPATCH_BATCH_MSG
 		else if (!last_dispatch_msg.empty() || recv_msg_buffer.try_dequeue(last_dispatch_msg))
+#else
+		else if (fill_dispatch_batch())
+#endif
 		{
 			post(boost::bind(&st_socket::msg_handler, this));
 			return true;
@@ -322,29 +596,79 @@ protected:
 			in_msg unused;
 			unused.swap(msg);
 			send_msg_buffer.enqueue(unused);
+			update_send_buffer_state();
 			send_msg();
 		}
 
 		return true;
 	}
 
+	//give up msg sending, subclasses call this in their send_handler when do_send_msg() returned false or the sending failed,
+	//return the state before SENDING been cleared.
+	unsigned char end_sending() {return send_state.fetch_and((unsigned char) ~SENDING);}
+
+	//call this after msgs been put into or taken out from the send buffer (subclasses call it in their send_handler),
+	//on_send_buffer_high() and on_send_buffer_low() are invoked from here.
+	void update_send_buffer_state()
+	{
+		if (send_buffer_full() ? !is_send_buffer_drained() : !is_send_buffer_full())
+			return;
+
+		//state changes and callbacks are serialized, so callbacks are invoked in pairs, the lock is recursive because sending msgs in callbacks
+		//(for example, in on_send_buffer_low()) will come here again in the same thread.
+		boost::lock_guard<boost::recursive_mutex> lock(send_buffer_state_mutex);
+		for (;;) //check again after invoking callbacks, because the send buffer may be changed in other threads concurrently
+			if (!send_buffer_full())
+			{
+				if (!is_send_buffer_full())
+					break;
+
+				send_state.fetch_or(SEND_BUFFER_FULL);
+				on_send_buffer_high();
+			}
+			else
+			{
+				if (!is_send_buffer_drained())
+					break;
+
+				send_state.fetch_and((unsigned char) ~SEND_BUFFER_FULL);
+				on_send_buffer_low();
+				notify_writable();
+			}
+	}
+
 private:
+	POP_FIRST_PENDING_MSG(do_pop_first_pending_send_msg, send_msg_buffer, InMsgType)
+	POP_ALL_PENDING_MSG(do_pop_all_pending_send_msg, send_msg_buffer, in_container_type)
+	POP_FIRST_PENDING_MSG(do_pop_first_pending_recv_msg, recv_msg_buffer, OutMsgType)
+	POP_ALL_PENDING_MSG(do_pop_all_pending_recv_msg, recv_msg_buffer, out_container_type)
+
+	bool send_buffer_full() const {return 0 != (send_state.load() & SEND_BUFFER_FULL);} //the hysteresis state, see update_send_buffer_state()
+	bool is_send_buffer_full() const {return send_msg_buffer.size() >= ST_ASIO_MAX_MSG_NUM || send_msg_buffer.size_in_bytes() >= send_high_bytes;}
+	bool is_send_buffer_drained() const {return send_msg_buffer.size() < ST_ASIO_SEND_BUFFER_LOW_WATERMARK && send_msg_buffer.size_in_bytes() <= send_low_bytes;}
+
+	void notify_writable()
+	{
+		boost::container::list<boost::function<void()> > handlers;
+		{
+			boost::lock_guard<boost::mutex> lock(writable_handlers_mutex);
+			handlers.swap(writable_handlers);
+		}
+
+		for (BOOST_AUTO(iter, handlers.begin()); iter != handlers.end(); ++iter)
+			post(*iter);
+	}
+
 	bool timer_handler(tid id)
 	{
 		switch (id)
 		{
-		case TIMER_HANDLE_MSG:
-			stat.recv_idle_sum += statistic::local_time() - recv_idle_begin_time;
-			handle_msg();
-			break;
-		case TIMER_DISPATCH_MSG:
-			dispatch_msg();
-			break;
 		case TIMER_DELAY_CLOSE:
 			if (!ST_THIS is_last_async_call())
 				return true;
 			else if (lowest_layer().is_open())
 			{
+				on_closing();
 				boost::system::error_code ec;
 				lowest_layer().close(ec);
 			}
@@ -352,6 +676,8 @@ private:
 #ifndef ST_ASIO_ENHANCED_STABILITY
 			closing = false;
 #endif
+			if (close_callback_)
+				close_callback_();
 			break;
 		default:
 			assert(false);
@@ -361,6 +687,32 @@ private:
 		return false;
 	}
 
+	//set busy_bit if neither busy_bit nor paused_bit is set, in one atomic operation, so a paused st_socket never starts sending (or dispatching),
+	//and only one thread can win, the winner owns msg sending (or dispatching) until it clears busy_bit.
+	static bool claim_state(st_atomic<unsigned char>& state, unsigned char busy_bit, unsigned char paused_bit)
+	{
+		unsigned char value = state.load();
+		while (!(value & (busy_bit | paused_bit)))
+			if (state.compare_exchange_strong(value, value | busy_bit))
+				return true;
+
+		return false;
+	}
+
+	//msg dispatching suspended or congestion control opened, on_msg() will not be invoked, and receiving will be suspended after recv buffer been full.
+	bool dispatch_blocked() const {return 0 != (recv_state.load() & (DISPATCH_PAUSED | CONGESTION_CONTROLLING));}
+
+	//only one resume_recv_msg() can succeed in claiming the suspended receiving, so handle_msg() will not be invoked concurrently.
+	bool claim_suspended_recv() {return recv_state.load() & RECV_SUSPENDED && recv_state.fetch_and((unsigned char) ~(RECV_SUSPENDED | ON_MSG_PENDING)) & RECV_SUSPENDED;}
+
+	void resume_handler()
+	{
+		stat.recv_idle_sum += statistic::local_time() - recv_idle_begin_time;
+		if (started())
+			handle_msg();
+	}
+
+#ifndef ST_ASIO_DISPATCH_BATCH_MSG
 	void msg_handler()
 	{
 		BOOST_AUTO(begin_time, statistic::local_time());
@@ -372,45 +724,187 @@ private:
 		if (!re) //dispatch failed, re-dispatch
 		{
 			last_dispatch_msg.restart(end_time);
-			dispatching = false;
-			set_timer(TIMER_DISPATCH_MSG, 50, boost::bind(&st_socket::timer_handler, this, _1));
+			redispatch_msg();
 		}
 		else //dispatch msg sequentially, which means second dispatching only after first dispatching success
 		{
 			last_dispatch_msg.clear();
-			if (!do_dispatch_msg())
+			dispatch_next_msg();
+		}
+	}
+#else
+	void msg_handler()
+	{
+		BOOST_AUTO(begin_time, statistic::local_time());
+		for (BOOST_AUTO(iter, last_dispatch_msgs.begin()); iter != last_dispatch_msgs.end(); ++iter)
+			stat.dispatch_dealy_sum += begin_time - iter->begin_time;
+		size_t num = on_msg_handle_batch(last_dispatch_msgs, false); //must before next msgs dispatching to keep sequence
+		BOOST_AUTO(end_time, statistic::local_time());
+		stat.handle_time_2_sum += end_time - begin_time;
+
+		if (num < last_dispatch_msgs.size()) //dispatch failed, re-dispatch the rest msgs (new msgs will be appended to them)
+		{
+			BOOST_AUTO(iter, last_dispatch_msgs.begin());
+			std::advance(iter, num);
+			last_dispatch_msgs.erase(last_dispatch_msgs.begin(), iter);
+			for (iter = last_dispatch_msgs.begin(); iter != last_dispatch_msgs.end(); ++iter)
+				iter->restart(end_time);
+			if (num > 0)
+				redispatch_interval = ST_ASIO_MIN_REDISPATCH_INTERVAL;
+			redispatch_msg();
+		}
+		else //dispatch msgs sequentially, which means second batch dispatching only after first batch dispatching success
+		{
+			last_dispatch_msgs.clear();
+			dispatch_next_msg();
+		}
+	}
+
+	//fetch msgs from recv buffer in one lock acquisition, and append them to last_dispatch_msgs until ST_ASIO_DISPATCH_BATCH_MSG msgs been gathered.
+	//return false if there's no msg to be dispatched.
+	bool fill_dispatch_batch()
+	{
+		if (last_dispatch_msgs.size() < ST_ASIO_DISPATCH_BATCH_MSG && !recv_msg_buffer.empty())
+		{
+			out_msg msg;
+			typename out_container_type::lock_guard lock(recv_msg_buffer);
+			while (last_dispatch_msgs.size() < ST_ASIO_DISPATCH_BATCH_MSG && recv_msg_buffer.try_dequeue_(msg))
+			{
+				last_dispatch_msgs.resize(last_dispatch_msgs.size() + 1);
+				last_dispatch_msgs.back().swap(msg);
+			}
+		}
+
+		return !last_dispatch_msgs.empty();
+	}
+#endif
+
+	//on_msg_handle() (or on_msg_handle_batch()) cannot handle msg(s) right now, re-dispatch according to the re-dispatch policy.
+	void redispatch_msg()
+	{
+		++stat.redispatch_sum;
+
+		//DISPATCHING is kept until this msg been re-dispatched, so new msgs will not trigger dispatching
+		if (REDISPATCH_IMMEDIATELY == redispatch_policy_)
+			continue_dispatching();
+		else
+		{
+			//the epoch only changes when a waiting msg been taken, and no msg is waiting now, so it's stable until we publish DISPATCH_WAITING.
+			size_t epoch = redispatch_state & ~(size_t) DISPATCH_STATE_MASK;
+			if (REDISPATCH_BACKOFF == redispatch_policy_)
+			{
+				//arm the timer before publishing DISPATCH_WAITING, after that, another thread can re-dispatch this msg and then set this timer again,
+				//if the timer expires before DISPATCH_WAITING been published, redispatch_timer_handler() will leave DISPATCH_NOTIFIED.
+				set_timer(TIMER_DISPATCH_MSG, redispatch_interval, boost::bind(&st_socket::redispatch_timer_handler, this, _1, epoch));
+				redispatch_interval = std::min(2 * redispatch_interval, (size_t) ST_ASIO_MAX_REDISPATCH_INTERVAL);
+			}
+
+			size_t state = epoch | DISPATCH_NOT_WAITING; //wait for TIMER_DISPATCH_MSG or resume_dispatch_msg()
+			if (!redispatch_state.compare_exchange_strong(state, epoch | DISPATCH_WAITING)) //resume_dispatch_msg() has been called or the timer expired
 			{
-				dispatching = false;
-				if (!recv_msg_buffer.empty())
-					dispatch_msg(); //just make sure no pending msgs
+				redispatch_state = next_wait(state);
+				stop_timer(TIMER_DISPATCH_MSG);
+				continue_dispatching();
 			}
 		}
 	}
 
+	//TIMER_DISPATCH_MSG expired, epoch identifies the wait it was set for, if the wait has been taken (by resume_dispatch_msg() or resetting),
+	//this expiration is stale and will be ignored, so it never shortens the delay of the next refused msg.
+	bool redispatch_timer_handler(tid id, size_t epoch)
+	{
+		size_t state = redispatch_state;
+		while (epoch == (state & ~(size_t) DISPATCH_STATE_MASK))
+			if (DISPATCH_WAITING == (state & DISPATCH_STATE_MASK))
+			{
+				if (redispatch_state.compare_exchange_strong(state, next_wait(state)))
+				{
+					continue_dispatching();
+					break;
+				}
+			}
+			//expired before redispatch_msg() published DISPATCH_WAITING, leave DISPATCH_NOTIFIED to it
+			else if (DISPATCH_NOTIFIED == (state & DISPATCH_STATE_MASK) || redispatch_state.compare_exchange_strong(state, state | DISPATCH_NOTIFIED))
+				break;
+
+		return false;
+	}
+
+	void dispatch_next_msg()
+	{
+		redispatch_interval = ST_ASIO_MIN_REDISPATCH_INTERVAL;
+		//forget the notification remembered by resume_dispatch_msg(), no msg is waiting now, so nobody else can change the state
+		size_t state = redispatch_state;
+		if (DISPATCH_NOTIFIED == (state & DISPATCH_STATE_MASK))
+			redispatch_state.compare_exchange_strong(state, state & ~(size_t) DISPATCH_STATE_MASK);
+		if (recv_state.load() & RECV_SUSPENDED && recv_resumable())
+			resume_recv_msg();
+
+		continue_dispatching();
+	}
+
+	void continue_dispatching()
+	{
+		if (!do_dispatch_msg())
+		{
+			recv_state.fetch_and((unsigned char) ~DISPATCHING);
+			if (!recv_msg_buffer.empty())
+				dispatch_msg(); //just make sure no pending msgs
+		}
+	}
+
 protected:
 	boost::uint_fast64_t _id;
 	Socket next_layer_;
 
+#ifndef ST_ASIO_DISPATCH_BATCH_MSG
 	out_msg last_dispatch_msg;
+#else
+	out_batch_type last_dispatch_msgs;
+#endif
+#ifdef ST_ASIO_STATIC_PACKER
+	static_object<Packer> packer_;
+#else
 	boost::shared_ptr<i_packer<typename Packer::msg_type> > packer_;
+#endif
 
 	in_container_type send_msg_buffer;
 	out_container_type recv_msg_buffer;
-	boost::container::list<out_msg> temp_msg_buffer;
-	//st_socket will invoke handle_msg() when got some msgs. if these msgs can't be pushed into recv_msg_buffer because of:
+	//st_socket will invoke handle_msg() when got some msgs. if these msgs can't be handled because of:
 	// 1. msg dispatching suspended;
 	// 2. congestion control opened;
-	//st_socket will delay 50 milliseconds(non-blocking) to invoke handle_msg() again, and now, as you known, temp_msg_buffer is used to hold these msgs temporarily.
-
-	bool sending, paused_sending;
-	boost::shared_mutex send_mutex;
-	bool dispatching, paused_dispatching, congestion_controlling;
-	boost::shared_mutex dispatch_mutex;
+	//st_socket will suspend receiving and invoke handle_msg() again after the cause disappeared (see resume_recv_msg()), until then, these msgs stay here.
+	boost::container::list<out_msg> temp_msg_buffer;
+	//msgs that should be pushed into recv_msg_buffer (on_msg() returned false or ST_ASIO_FORCE_TO_USE_MSG_RECV_BUFFER been defined), but recv_msg_buffer
+	//is full, this only happens with fixed capacity queues (like ring_queue), msgs in it will be pushed into recv_msg_buffer before receiving the next msg.
+	boost::container::list<out_msg> overflow_msg_buffer;
+
+	//lock-free state machines, all flags of one direction live in one atomic variable, so they are always changed and checked consistently,
+	//SENDING (DISPATCHING) can only be set by claim_state(), which fails if it's already set or SEND_PAUSED (DISPATCH_PAUSED) is set.
+	enum send_state_bits {SENDING = 1, SEND_PAUSED = 2, SEND_BUFFER_FULL = 4};
+	//SEND_BUFFER_FULL: send buffer became full and has not dropped to the low watermarks yet, see update_send_buffer_state()
+	st_atomic<unsigned char> send_state;
+	boost::recursive_mutex send_buffer_state_mutex;
+	boost::container::list<boost::function<void()> > writable_handlers; //see async_wait_writable()
+	boost::mutex writable_handlers_mutex;
+	enum recv_state_bits {DISPATCHING = 1, DISPATCH_PAUSED = 2, CONGESTION_CONTROLLING = 4, RECV_SUSPENDED = 8, ON_MSG_PENDING = 16};
+	//RECV_SUSPENDED: handle_msg() stopped receiving, and waiting for resume_recv_msg()
+	//ON_MSG_PENDING: set together with RECV_SUSPENDED if msgs were left in temp_msg_buffer (see recv_resumable())
+	st_atomic<unsigned char> recv_state;
+	enum redispatch_states {DISPATCH_NOT_WAITING, DISPATCH_WAITING, DISPATCH_NOTIFIED, DISPATCH_STATE_MASK};
+	//low two bits: one of redispatch_states, a refused msg is waiting for TIMER_DISPATCH_MSG or resume_dispatch_msg();
+	//other bits: the epoch of the wait, it increases each time a waiting msg been taken, so stale expirations of TIMER_DISPATCH_MSG can be recognized.
+	st_atomic<size_t> redispatch_state;
+	static size_t next_wait(size_t state) {return (state | DISPATCH_STATE_MASK) + 1;}
+	redispatch_policies redispatch_policy_;
+	size_t redispatch_interval;
 #ifndef ST_ASIO_ENHANCED_STABILITY
 	bool closing;
 #endif
+	size_t send_high_bytes, send_low_bytes, recv_high_bytes, recv_low_bytes; //see send_buffer_watermark() and recv_buffer_watermark()
 
 	bool started_; //has started or not
+	boost::function<void()> close_callback_; //see close_callback()
 	boost::shared_mutex start_mutex;
 
 	struct statistic stat;
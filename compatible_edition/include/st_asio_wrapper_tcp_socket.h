@@ -17,6 +17,25 @@
 
 #include "st_asio_wrapper_socket.h"
 
+#ifdef ST_ASIO_ZEROCOPY_SEND
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+//for old headers
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY					60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY				0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY		5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED	1
+#endif
+#endif
+
 #ifndef ST_ASIO_GRACEFUL_SHUTDOWN_MAX_DURATION
 #define ST_ASIO_GRACEFUL_SHUTDOWN_MAX_DURATION	5 //seconds, maximum duration while graceful shutdown
 #elif ST_ASIO_GRACEFUL_SHUTDOWN_MAX_DURATION <= 0
@@ -32,6 +51,7 @@ template <typename Socket, typename Packer, typename Unpacker,
 class st_tcp_socket_base : public st_socket<Socket, Packer, Unpacker, typename Packer::msg_type, typename Unpacker::msg_type, InQueue, InContainer, OutQueue, OutContainer>
 {
 public:
+	typedef Packer packer_type;
 	typedef typename Packer::msg_type in_msg_type;
 	typedef typename Packer::msg_ctype in_msg_ctype;
 	typedef typename Unpacker::msg_type out_msg_type;
@@ -44,9 +64,29 @@ protected:
 
 	enum shutdown_states {NONE, FORCE, GRACEFUL};
 
-	st_tcp_socket_base(boost::asio::io_service& io_service_) : super(io_service_), unpacker_(boost::make_shared<Unpacker>()), shutdown_state(NONE) {}
+	st_tcp_socket_base(boost::asio::io_service& io_service_) : super(io_service_),
+#ifndef ST_ASIO_STATIC_UNPACKER
+		unpacker_(boost::make_shared<Unpacker>()),
+#endif
+		shutdown_state(NONE)
+	{
+#ifdef ST_ASIO_ZEROCOPY_SEND
+		zerocopy_generation = 0;
+		reset_zerocopy_state();
+#endif
+	}
 	template<typename Arg>
-	st_tcp_socket_base(boost::asio::io_service& io_service_, Arg& arg) : super(io_service_, arg), unpacker_(boost::make_shared<Unpacker>()), shutdown_state(NONE) {}
+	st_tcp_socket_base(boost::asio::io_service& io_service_, Arg& arg) : super(io_service_, arg),
+#ifndef ST_ASIO_STATIC_UNPACKER
+		unpacker_(boost::make_shared<Unpacker>()),
+#endif
+		shutdown_state(NONE)
+	{
+#ifdef ST_ASIO_ZEROCOPY_SEND
+		zerocopy_generation = 0;
+		reset_zerocopy_state();
+#endif
+	}
 
 public:
 	virtual bool obsoleted() {return !is_shutting_down() && super::obsoleted();}
@@ -56,17 +96,26 @@ public:
 	void reset_state()
 	{
 		unpacker_->reset_state();
+#ifdef ST_ASIO_ZEROCOPY_SEND
+		reset_zerocopy_state();
+#endif
 		super::reset_state();
 	}
 
 	bool is_shutting_down() const {return NONE != shutdown_state;}
 
+#ifdef ST_ASIO_STATIC_UNPACKER
+	//the unpacker is held by value and called without virtual dispatching, it can be configured but not changed at runtime
+	Unpacker& inner_unpacker() {return *unpacker_;}
+	const Unpacker& inner_unpacker() const {return *unpacker_;}
+#else
 	//get or change the unpacker at runtime
 	//changing unpacker at runtime is not thread-safe, this operation can only be done in on_msg(), reset() or constructor, please pay special attention
 	//we can resolve this defect via mutex, but i think it's not worth, because this feature is not frequently used
 	boost::shared_ptr<i_unpacker<out_msg_type> > inner_unpacker() {return unpacker_;}
 	boost::shared_ptr<const i_unpacker<out_msg_type> > inner_unpacker() const {return unpacker_;}
 	void inner_unpacker(const boost::shared_ptr<i_unpacker<out_msg_type> >& _unpacker_) {unpacker_ = _unpacker_;}
+#endif
 
 	using super::send_msg;
 	///////////////////////////////////////////////////
@@ -119,13 +168,16 @@ protected:
 		if (is_send_allowed() && !ST_THIS stopped() && !ST_THIS send_msg_buffer.empty())
 		{
 			std::vector<boost::asio::const_buffer> bufs;
+			size_t size = 0;
+#ifdef ST_ASIO_ZEROCOPY_SEND
+			bool has_file = false;
+#endif
 			{
 #ifdef ST_ASIO_WANT_MSG_SEND_NOTIFY
 				const size_t max_send_size = 0;
 #else
 				const size_t max_send_size = boost::asio::detail::default_max_transfer_size;
 #endif
-				size_t size = 0;
 				typename super::in_msg msg;
 				BOOST_AUTO(end_time, statistic::local_time());
 
@@ -136,7 +188,11 @@ protected:
 					size += msg.size();
 					last_send_msg.resize(last_send_msg.size() + 1);
 					last_send_msg.back().swap(msg);
-					bufs.push_back(boost::asio::buffer(last_send_msg.back().data(), last_send_msg.back().size()));
+					gather_buffers((in_msg_ctype&) last_send_msg.back(), bufs); //cast to in_msg_ctype to match gather_buffers overloads exactly
+#ifdef ST_ASIO_ZEROCOPY_SEND
+					file_region region;
+					has_file = get_file_region((in_msg_ctype&) last_send_msg.back(), region) || has_file;
+#endif
 					if (size >= max_send_size)
 						break;
 				}
@@ -145,6 +201,19 @@ protected:
 			if (!bufs.empty())
 			{
 				last_send_msg.front().restart();
+#ifdef ST_ASIO_ZEROCOPY_SEND
+				if (boost::is_same<Socket, boost::asio::ip::tcp::socket>::value && (has_file || size >= ST_ASIO_ZEROCOPY_THRESHOLD) && prepare_zerocopy_send(size))
+				{
+					zerocopy_send(true);
+					return true;
+				}
+				else if (has_file) //ssl sockets must not bypass the ssl layer, so they cannot send file-backed msgs, neither can blocking sockets
+				{
+					segment_sent = 0;
+					post_send_handler(boost::asio::error::operation_not_supported);
+					return true;
+				}
+#endif
 				boost::asio::async_write(ST_THIS next_layer(), bufs,
 					ST_THIS make_handler_error_size(boost::bind(&st_tcp_socket_base::send_handler, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
 
@@ -157,11 +226,35 @@ protected:
 
 	virtual void do_recv_msg()
 	{
-		BOOST_AUTO(recv_buff, unpacker_->prepare_next_recv());
+		//wait for readability without holding a receive buffer, see i_unpacker::idle. ssl sockets must always read through the ssl layer,
+		//openssl may hold decrypted data while the socket itself is not readable, so they keep their receive buffers.
+		if (boost::is_same<Socket, boost::asio::ip::tcp::socket>::value && unpacker_->idle())
+		{
+#if BOOST_VERSION >= 106600
+			ST_THIS lowest_layer().async_wait(boost::asio::socket_base::wait_read, ST_THIS make_handler_error(boost::bind(&st_tcp_socket_base::readable_handler, this, boost::asio::placeholders::error)));
+#else
+			static_cast<boost::asio::ip::tcp::socket&>(ST_THIS lowest_layer()).async_receive(boost::asio::null_buffers(), ST_THIS make_handler_error_size(boost::bind(&st_tcp_socket_base::readable_handler, this, boost::asio::placeholders::error)));
+#endif
+		}
+		else
+			do_read_msg();
+	}
+
+	void do_read_msg()
+	{
+		BOOST_AUTO(recv_buff, unpacker_->prepare_next_recv_buffers());
 		assert(boost::asio::buffer_size(recv_buff) > 0);
 
+		if (0 == boost::asio::buffer_size(recv_buff[1])) //receive into one buffer as before, it's a bit more efficient than two buffers
+			do_async_read(boost::asio::mutable_buffers_1(recv_buff[0]));
+		else
+			do_async_read(recv_buff);
+	}
+
+	template<typename Buffers> void do_async_read(const Buffers& recv_buff)
+	{
 		boost::asio::async_read(ST_THIS next_layer(), recv_buff,
-			boost::bind(&i_unpacker<out_msg_type>::completion_condition, unpacker_, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred),
+			boost::bind(&st_tcp_socket_base::completion_checker, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred),
 			ST_THIS make_handler_error_size(boost::bind(&st_tcp_socket_base::recv_handler, this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
 	}
 
@@ -177,6 +270,10 @@ protected:
 #endif
 
 	virtual bool on_msg_handle(out_msg_type& msg, bool link_down) {unified_out::debug_out("recv(" ST_ASIO_SF "): %s", msg.size(), msg.data()); return true;}
+#ifdef ST_ASIO_ZEROCOPY_SEND
+	//the last chance to read the socket's error queue, hand uncompleted msgs over to a duplicate of the fd, see retire_zerocopy_msgs().
+	virtual void on_closing() {{boost::lock_guard<boost::mutex> lock(zerocopy_mutex); retire_zerocopy_msgs();} super::on_closing();}
+#endif
 
 	void shutdown()
 	{
@@ -192,10 +289,16 @@ protected:
 		{
 			boost::system::error_code ec;
 			ST_THIS lowest_layer().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+#ifdef ST_ASIO_ZEROCOPY_SEND
+			boost::lock_guard<boost::mutex> lock(zerocopy_mutex);
+			retire_zerocopy_msgs();
+#endif
 		}
 	}
 
 private:
+	size_t completion_checker(const boost::system::error_code& ec, size_t bytes_transferred) {return unpacker_->completion_condition(ec, bytes_transferred);}
+	void readable_handler(const boost::system::error_code& ec) {if (ec) recv_handler(ec, 0); else do_read_msg();}
 	void recv_handler(const boost::system::error_code& ec, size_t bytes_transferred)
 	{
 		if (!ec && bytes_transferred > 0)
@@ -214,14 +317,16 @@ private:
 					(++op_iter).base()->swap(*iter.base());
 				}
 			}
-			ST_THIS handle_msg();
 
+			//must before handle_msg(), because handle_msg() may start the next reading into the unpacker's receive buffer, which will be given back
+			//by reset_state() (see ST_ASIO_LAZY_RECV_BUFFER).
 			if (!unpack_ok)
 			{
 				on_unpack_error();
 				//reset unpacker's state after on_unpack_error(), so user can get the left half-baked msg in on_unpack_error()
 				unpacker_->reset_state();
 			}
+			ST_THIS handle_msg();
 		}
 		else
 			ST_THIS on_recv_error(ec);
@@ -244,24 +349,371 @@ private:
 		}
 		else
 			ST_THIS on_send_error(ec);
+#ifdef ST_ASIO_ZEROCOPY_SEND
+		hold_zerocopy_msgs(); //must before clearing last_send_msg
+#endif
 		last_send_msg.clear();
+		ST_THIS update_send_buffer_state();
 
 		if (ec)
-			ST_THIS sending = false;
+			ST_THIS end_sending();
 		else if (!do_send_msg()) //send msg sequentially, which means second sending only after first sending success
 		{
-			ST_THIS sending = false;
+			ST_THIS end_sending();
 			if (!ST_THIS send_msg_buffer.empty())
 				ST_THIS send_msg(); //just make sure no pending msgs
 		}
 	}
 
+#ifdef ST_ASIO_ZEROCOPY_SEND
+	void reset_zerocopy_state()
+	{
+		boost::lock_guard<boost::mutex> lock(zerocopy_mutex);
+		zerocopy_prepared = non_blocking_on = zerocopy_on = zerocopy_used = errqueue_waiting = false;
+		zerocopy_next_id = 0;
+		++zerocopy_generation; //ignore the notifications of the previous connection
+		//on_closing() retires uncompleted msgs before the socket been closed, if it's still open (reset without closing), retire them now.
+		if (!zerocopy_batches.empty() && ST_THIS lowest_layer().is_open())
+			retire_zerocopy_msgs();
+		//only possible if the socket been closed bypassing st_socket (on_closing() was not invoked), their completions cannot be known anymore.
+		assert(zerocopy_batches.empty());
+		if (!zerocopy_batches.empty())
+		{
+			unified_out::error_out("the socket been closed with " ST_ASIO_SF " uncompleted zero copy batch(es).", zerocopy_batches.size());
+			zerocopy_batches.clear();
+		}
+	}
+
+	//split last_send_msg into memory segments (sent by sendmsg) and file segments (sent by sendfile)
+	//return false if the socket cannot be switched to non-blocking mode, then segments must not be sent by zerocopy_send().
+	bool prepare_zerocopy_send(size_t size)
+	{
+		segments.clear();
+		segment_index = segment_offset = segment_sent = 0;
+		for (BOOST_AUTO(iter, last_send_msg.begin()); iter != last_send_msg.end(); ++iter)
+		{
+			send_segment segment;
+			if (get_file_region((in_msg_ctype&) *iter, segment.region))
+			{
+				segment.data = NULL;
+				segment.size = segment.region.size;
+				if (segment.size > 0)
+					segments.push_back(segment);
+			}
+			else
+			{
+				std::vector<boost::asio::const_buffer> bufs;
+				gather_buffers((in_msg_ctype&) *iter, bufs);
+				for (BOOST_AUTO(buff_iter, bufs.begin()); buff_iter != bufs.end(); ++buff_iter)
+				{
+					segment.data = boost::asio::buffer_cast<const char*>(*buff_iter);
+					segment.size = boost::asio::buffer_size(*buff_iter);
+					if (segment.size > 0)
+						segments.push_back(segment);
+				}
+			}
+		}
+
+		boost::lock_guard<boost::mutex> lock(zerocopy_mutex);
+		if (!zerocopy_prepared)
+		{
+			zerocopy_prepared = true;
+
+			boost::system::error_code ec;
+			ST_THIS lowest_layer().native_non_blocking(true, ec); //sendfile has no flags like MSG_DONTWAIT
+			non_blocking_on = !ec;
+#ifdef ST_ASIO_WANT_MSG_SEND_NOTIFY
+			zerocopy_on = false; //on_msg_send() hands msgs back before the kernel read them, they may be reused (see file_server)
+#else
+			int on = 1;
+			zerocopy_on = non_blocking_on && 0 == ::setsockopt(ST_THIS lowest_layer().native_handle(), SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on));
+#endif
+		}
+		zerocopy_this_time = zerocopy_on && size >= ST_ASIO_ZEROCOPY_THRESHOLD;
+
+		return non_blocking_on;
+	}
+
+	//send segments without blocking, wait for writability if the socket send buffer is full, it ends by send_handler.
+	//once means only try one sendmsg or sendfile, and send the rest after the socket became writable, it's for do_send_msg(), which can be invoked in
+	//msg senders' threads, they should not be occupied by sending big msgs or files.
+	void zerocopy_send(bool once = false)
+	{
+		BOOST_AUTO(fd, ST_THIS lowest_layer().native_handle());
+		while (segment_index < segments.size())
+		{
+			ssize_t re;
+			const send_segment& segment = segments[segment_index];
+			if (NULL == segment.data)
+			{
+				off_t offset = segment.region.offset + (off_t) segment_offset;
+				re = ::sendfile(fd, segment.region.fd, &offset, segment.size - segment_offset);
+				if (0 == re) //the file is shorter than expected
+				{
+					post_send_handler(boost::asio::error::eof);
+					return;
+				}
+			}
+			else
+			{
+				struct iovec iov[64];
+				struct msghdr hdr;
+				memset(&hdr, 0, sizeof(hdr));
+				hdr.msg_iov = iov;
+				for (size_t i = segment_index; i < segments.size() && NULL != segments[i].data && hdr.msg_iovlen < sizeof(iov) / sizeof(iov[0]); ++i, ++hdr.msg_iovlen)
+				{
+					size_t offset = i == segment_index ? segment_offset : 0;
+					iov[hdr.msg_iovlen].iov_base = const_cast<char*>(segments[i].data) + offset;
+					iov[hdr.msg_iovlen].iov_len = segments[i].size - offset;
+				}
+
+				re = ::sendmsg(fd, &hdr, MSG_DONTWAIT | MSG_NOSIGNAL | (zerocopy_this_time ? MSG_ZEROCOPY : 0));
+				if (zerocopy_this_time)
+				{
+					if (re > 0) //the kernel numbers successful MSG_ZEROCOPY calls from zero on each socket
+					{
+						++zerocopy_next_id;
+						zerocopy_used = true;
+					}
+					else if (re < 0 && ENOBUFS == errno) //too many pages pinned (the optmem limit), copy them instead
+					{
+						zerocopy_this_time = false;
+						continue;
+					}
+				}
+			}
+
+			if (re < 0)
+			{
+				if (EINTR == errno)
+					continue;
+				else if (EAGAIN == errno || EWOULDBLOCK == errno)
+					wait_to_send();
+				else
+					post_send_handler(boost::system::error_code(errno, boost::asio::error::get_system_category()));
+
+				return;
+			}
+
+			segment_sent += (size_t) re;
+			for (size_t left = (size_t) re; left > 0;)
+			{
+				size_t rest = segments[segment_index].size - segment_offset;
+				if (left < rest)
+				{
+					segment_offset += left;
+					break;
+				}
+
+				left -= rest;
+				++segment_index;
+				segment_offset = 0;
+			}
+
+			if (once && segment_index < segments.size())
+			{
+				wait_to_send();
+				return;
+			}
+		}
+
+		post_send_handler(boost::system::error_code());
+	}
+	void wait_to_send()
+	{
+#if BOOST_VERSION >= 106600
+		ST_THIS lowest_layer().async_wait(boost::asio::socket_base::wait_write, ST_THIS make_handler_error(boost::bind(&st_tcp_socket_base::writable_handler, this, boost::asio::placeholders::error)));
+#else
+		static_cast<boost::asio::ip::tcp::socket&>(ST_THIS lowest_layer()).async_send(boost::asio::null_buffers(), ST_THIS make_handler_error_size(boost::bind(&st_tcp_socket_base::writable_handler, this, boost::asio::placeholders::error)));
+#endif
+	}
+	//zerocopy_send() may be invoked from within do_send_msg() in any thread, so invoking send_handler() directly may recurse (send_handler() invokes
+	//do_send_msg() again) without limitation, and callbacks (like on_msg_send()) would be invoked in msg senders' threads.
+	void post_send_handler(const boost::system::error_code& ec) {ST_THIS post(boost::bind(&st_tcp_socket_base::send_handler, this, ec, segment_sent));}
+	void writable_handler(const boost::system::error_code& ec) {if (ec) send_handler(ec, segment_sent); else zerocopy_send();}
+
+	//msgs sent by MSG_ZEROCOPY must be kept until the kernel reports the completion
+	void hold_zerocopy_msgs()
+	{
+		if (!zerocopy_used)
+			return;
+
+		zerocopy_used = false;
+		boost::lock_guard<boost::mutex> lock(zerocopy_mutex);
+		zerocopy_batches.resize(zerocopy_batches.size() + 1);
+		zerocopy_batches.back().last_id = zerocopy_next_id - 1;
+		zerocopy_batches.back().msgs.splice(zerocopy_batches.back().msgs.end(), last_send_msg);
+
+		if (FORCE == shutdown_state) //shutdown() has retired uncompleted msgs, and the fd is still open before the delayed closing
+			retire_zerocopy_msgs();
+		else if (!errqueue_waiting)
+		{
+			errqueue_waiting = true;
+			wait_errqueue(zerocopy_generation);
+		}
+		drain_errqueue(); //notifications arrived before the waiting
+	}
+
+	void wait_errqueue(size_t generation) //zerocopy_mutex must be locked
+	{
+#if BOOST_VERSION >= 106600
+		ST_THIS lowest_layer().async_wait(boost::asio::socket_base::wait_error,
+			ST_THIS make_handler_error(boost::bind(&st_tcp_socket_base::errqueue_handler, this, boost::asio::placeholders::error, generation)));
+#else
+		static_cast<boost::asio::ip::tcp::socket&>(ST_THIS lowest_layer()).async_receive(boost::asio::null_buffers(), boost::asio::socket_base::message_out_of_band,
+			ST_THIS make_handler_error_size(boost::bind(&st_tcp_socket_base::errqueue_handler, this, boost::asio::placeholders::error, generation)));
+#endif
+	}
+
+	void errqueue_handler(const boost::system::error_code& ec, size_t generation)
+	{
+		boost::lock_guard<boost::mutex> lock(zerocopy_mutex);
+		if (generation != zerocopy_generation) //from the previous connection
+			return;
+		else if (ec) //link broken, msgs will be retired by shutdown()
+		{
+			errqueue_waiting = false;
+			return;
+		}
+
+		drain_errqueue();
+		if (zerocopy_batches.empty())
+			errqueue_waiting = false;
+		else
+		{
+			wait_errqueue(generation);
+			drain_errqueue(); //notifications arrived between the first draining and the waiting
+		}
+	}
+
+	void drain_errqueue() {if (drain_errqueue(ST_THIS lowest_layer().native_handle(), zerocopy_batches)) zerocopy_on = false;} //zerocopy_mutex must be locked
+
+	//the link is being closed, but the kernel may still be transmitting uncompleted msgs (graceful shutdown keeps sending queued data), hand them
+	//over to a duplicate of the fd (the error queue belongs to the socket, not the fd), which will release them as completions arrive, even after
+	//this st_tcp_socket_base been reset or freed.
+	void retire_zerocopy_msgs() //zerocopy_mutex must be locked
+	{
+		drain_errqueue();
+		if (zerocopy_batches.empty())
+			return;
+
+		boost::system::error_code ec;
+		BOOST_AUTO(protocol, ST_THIS lowest_layer().local_endpoint(ec).protocol());
+		int fd = ::dup(ST_THIS lowest_layer().native_handle());
+		boost::shared_ptr<retired_zerocopy_batches> retired = boost::make_shared<retired_zerocopy_batches>(boost::ref(ST_THIS get_io_service()));
+		if (fd >= 0)
+			retired->socket.assign(protocol, fd, ec);
+		if (fd < 0 || ec)
+		{
+			if (fd >= 0)
+				::close(fd);
+			return; //reset_zerocopy_state() will leak them
+		}
+
+		retired->batches.splice(retired->batches.end(), zerocopy_batches);
+		wait_retired_errqueue(retired);
+	}
+
+	struct zerocopy_batch
+	{
+		uint32_t last_id;
+		boost::container::list<typename super::in_msg> msgs;
+	};
+	struct retired_zerocopy_batches
+	{
+		retired_zerocopy_batches(boost::asio::io_service& io_service_) : socket(io_service_) {}
+
+		boost::asio::ip::tcp::socket socket; //owns the duplicated fd
+		boost::container::list<zerocopy_batch> batches;
+		boost::mutex mutex;
+	};
+	//no st_tcp_socket_base is involved, retired batches only live in the handler, and will be released when the io_service stops.
+	static void wait_retired_errqueue(const boost::shared_ptr<retired_zerocopy_batches>& retired)
+	{
+		boost::lock_guard<boost::mutex> lock(retired->mutex);
+		drain_errqueue(retired->socket.native_handle(), retired->batches);
+		if (retired->batches.empty())
+			return;
+
+#if BOOST_VERSION >= 106600
+		retired->socket.async_wait(boost::asio::socket_base::wait_error, boost::bind(&st_tcp_socket_base::retired_errqueue_handler, retired, boost::asio::placeholders::error));
+#else
+		retired->socket.async_receive(boost::asio::null_buffers(), boost::asio::socket_base::message_out_of_band,
+			boost::bind(&st_tcp_socket_base::retired_errqueue_handler, retired, boost::asio::placeholders::error));
+#endif
+		//notifications arrived between the draining and the waiting, the waiting will not be fired for them, close the socket to finish it
+		drain_errqueue(retired->socket.native_handle(), retired->batches);
+		if (retired->batches.empty())
+		{
+			boost::system::error_code ec;
+			retired->socket.close(ec);
+		}
+	}
+	static void retired_errqueue_handler(const boost::shared_ptr<retired_zerocopy_batches>& retired, const boost::system::error_code& ec)
+		{if (!ec) wait_retired_errqueue(retired);}
+
+	//tcp reports completions in order (adjacent ranges are merged), so a notification [lo, hi] completes all sendings up to hi
+	//return true if the kernel copied the data anyway (for example, loopback), then zero copy only costs more.
+	static bool drain_errqueue(int fd, boost::container::list<zerocopy_batch>& batches)
+	{
+		bool copied = false;
+		char control[128];
+		struct msghdr hdr;
+		for (;;)
+		{
+			memset(&hdr, 0, sizeof(hdr));
+			hdr.msg_control = control;
+			hdr.msg_controllen = sizeof(control);
+			if (::recvmsg(fd, &hdr, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+				break;
+
+			for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); NULL != cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+				if ((SOL_IP == cmsg->cmsg_level && IP_RECVERR == cmsg->cmsg_type) || (SOL_IPV6 == cmsg->cmsg_level && IPV6_RECVERR == cmsg->cmsg_type))
+				{
+					const struct sock_extended_err* err = (const struct sock_extended_err*) CMSG_DATA(cmsg);
+					if (SO_EE_ORIGIN_ZEROCOPY != err->ee_origin || 0 != err->ee_errno)
+						continue;
+
+					if (SO_EE_CODE_ZEROCOPY_COPIED & err->ee_code)
+						copied = true;
+					while (!batches.empty() && (int32_t) (batches.front().last_id - err->ee_data) <= 0)
+						batches.pop_front();
+				}
+		}
+
+		return copied;
+	}
+#endif
+
 protected:
 	boost::container::list<typename super::in_msg> last_send_msg;
+#ifdef ST_ASIO_STATIC_UNPACKER
+	static_object<Unpacker> unpacker_;
+#else
 	boost::shared_ptr<i_unpacker<out_msg_type> > unpacker_;
+#endif
 	shutdown_states shutdown_state;
 
 	boost::shared_mutex shutdown_mutex;
+
+#ifdef ST_ASIO_ZEROCOPY_SEND
+	struct send_segment
+	{
+		const char* data; //NULL means file-backed
+		size_t size;
+		file_region region;
+	};
+	std::vector<send_segment> segments;
+	size_t segment_index, segment_offset, segment_sent;
+	bool zerocopy_this_time, zerocopy_used; //only accessed by the sending
+
+	//the followings are shared by the sending and errqueue_handler
+	boost::container::list<zerocopy_batch> zerocopy_batches; //waiting for the kernel's completion notifications
+	bool zerocopy_prepared, non_blocking_on, zerocopy_on, errqueue_waiting;
+	uint32_t zerocopy_next_id;
+	size_t zerocopy_generation;
+	boost::mutex zerocopy_mutex;
+#endif
 };
 
 } //namespace
@@ -11,6 +11,8 @@
 #define ST_ASIO_MSG_BUFFER_SIZE 65536
 #define ST_ASIO_INPUT_QUEUE non_lock_queue //we will never operate sending buffer concurrently, so need no locks.
 #define ST_ASIO_DEFAULT_UNPACKER stream_unpacker //non-protocol
+//#define ST_ASIO_IO_SERVICE_PER_THREAD //one io_service per service thread, see pingpong_server for more details
+//#define ST_ASIO_PIN_SERVICE_THREAD
 //configuration
 
 #include "../include/ext/st_asio_wrapper_client.h"
@@ -117,9 +119,12 @@ public:
 	statistic get_statistic()
 	{
 		statistic stat;
-		boost::shared_lock<boost::shared_mutex> lock(ST_THIS object_can_mutex);
-		for (BOOST_AUTO(iter, ST_THIS object_can.begin()); iter != ST_THIS object_can.end(); ++iter)
-			stat += (*iter)->get_statistic();
+		for (size_t i = 0; i < ST_THIS shard_num(); ++i)
+		{
+			boost::shared_lock<boost::shared_mutex> lock(ST_THIS shards[i].object_can_mutex);
+			for (BOOST_AUTO(iter, ST_THIS shards[i].object_can.begin()); iter != ST_THIS shards[i].object_can.end(); ++iter)
+				stat += (*iter)->get_statistic();
+		}
 
 		return stat;
 	}
@@ -143,9 +148,6 @@ int main(int argc, const char* argv[])
 	printf("exec: echo_client with " ST_ASIO_SF " links\n", link_num);
 	///////////////////////////////////////////////////////////
 
-	st_service_pump sp;
-	echo_client client(sp);
-
 //	argv[2] = "::1" //ipv6
 //	argv[2] = "127.0.0.1" //ipv4
 	std::string ip = argc > 3 ? argv[3] : ST_ASIO_SERVER_IP;
@@ -162,6 +164,13 @@ int main(int argc, const char* argv[])
 	//the server has such behavior too.
 #endif
 
+#ifdef ST_ASIO_IO_SERVICE_PER_THREAD
+	st_service_pump sp(thread_num);
+#else
+	st_service_pump sp;
+#endif
+	echo_client client(sp);
+
 	for (size_t i = 0; i < link_num; ++i)
 		client.add_client(port, ip);
 
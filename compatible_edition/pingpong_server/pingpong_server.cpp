@@ -14,7 +14,10 @@
 //
 //if pingpong_client send message in on_msg_send(), then using non_lock_queue as input queue in pingpong_server will lead
 //undefined behavior, please note.
+//#define ST_ASIO_OUTPUT_QUEUE ring_queue //makes sense only with ST_ASIO_FORCE_TO_USE_MSG_RECV_BUFFER, recv buffer has one producer (handle_msg) and one consumer (dispatching), no locks and no allocations
 #define ST_ASIO_DEFAULT_UNPACKER stream_unpacker //non-protocol
+//#define ST_ASIO_IO_SERVICE_PER_THREAD //one io_service per service thread, compare IO throughput with the default mode under different service thread numbers
+//#define ST_ASIO_PIN_SERVICE_THREAD
 //configuration
 
 #include "../include/ext/st_asio_wrapper_server.h"
@@ -93,9 +96,12 @@ public:
 	statistic get_statistic()
 	{
 		statistic stat;
-		boost::shared_lock<boost::shared_mutex> lock(ST_THIS object_can_mutex);
-		for (BOOST_AUTO(iter, ST_THIS object_can.begin()); iter != ST_THIS object_can.end(); ++iter)
-			stat += (*iter)->get_statistic();
+		for (size_t i = 0; i < ST_THIS shard_num(); ++i)
+		{
+			boost::shared_lock<boost::shared_mutex> lock(ST_THIS shards[i].object_can_mutex);
+			for (BOOST_AUTO(iter, ST_THIS shards[i].object_can.begin()); iter != ST_THIS shards[i].object_can.end(); ++iter)
+				stat += (*iter)->get_statistic();
+		}
 
 		return stat;
 	}
@@ -112,7 +118,15 @@ int main(int argc, const char* argv[])
 	else
 		puts("type " QUIT_COMMAND " to end.");
 
+	int thread_num = 1;
+	if (argc > 1)
+		thread_num = std::min(16, std::max(thread_num, atoi(argv[1])));
+
+#ifdef ST_ASIO_IO_SERVICE_PER_THREAD
+	st_service_pump sp(thread_num);
+#else
 	st_service_pump sp;
+#endif
 	echo_server echo_server_(sp);
 
 	if (argc > 3)
@@ -120,10 +134,6 @@ int main(int argc, const char* argv[])
 	else if (argc > 2)
 		echo_server_.set_server_addr(atoi(argv[2]));
 
-	int thread_num = 1;
-	if (argc > 1)
-		thread_num = std::min(16, std::max(thread_num, atoi(argv[1])));
-
 	sp.start_service(thread_num);
 	while(sp.is_running())
 	{
@@ -136,6 +146,10 @@ int main(int argc, const char* argv[])
 			printf("link #: " ST_ASIO_SF ", invalid links: " ST_ASIO_SF "\n", echo_server_.size(), echo_server_.invalid_object_size());
 			puts("");
 			puts(echo_server_.get_statistic().to_string().data());
+#ifdef ST_ASIO_IO_SERVICE_PER_THREAD
+			for (size_t i = 0; i < sp.io_service_num(); ++i)
+				printf("links in io_service #" ST_ASIO_SF ": " ST_ASIO_SF "\n", i, sp.io_service_load(i));
+#endif
 		}
 	}
 
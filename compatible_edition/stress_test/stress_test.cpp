@@ -0,0 +1,201 @@
+#include <iostream>
+#include <boost/thread.hpp>
+
+//configuration
+#define ST_ASIO_SERVER_PORT		9528
+#define ST_ASIO_FORCE_TO_USE_MSG_RECV_BUFFER //all msgs go through msg dispatching, so it can be suspended and resumed
+#define ST_ASIO_MAX_MSG_NUM		64 //small buffers, so receiving will be suspended and resumed frequently
+#define ST_ASIO_LAZY_RECV_BUFFER //receive buffers are borrowed from buffer_pool only when there's data to be received
+#define ST_ASIO_NO_UNIFIED_OUT
+//#define ST_ASIO_INPUT_QUEUE lock_free_queue //all sender threads enqueue concurrently
+//configuration
+
+#include "../include/ext/st_asio_wrapper_server.h"
+#include "../include/ext/st_asio_wrapper_client.h"
+using namespace st_asio_wrapper;
+using namespace st_asio_wrapper::ext;
+
+//this demo is a self-checking stress test, it exits with 0 if all tests passed.
+//
+//send race test: many threads send msgs via the same link, the sending can be suspended and resumed at any time (so can the msg dispatching
+//of the peer), then, after the sending been resumed, more msgs are enqueued while send_handler is giving up the sending (nothing else
+//will send them if send_handler missed them). after each round, all msgs must arrive within the time limit, otherwise some msgs were
+//left in the send buffer (or the recv buffer) without anybody sending (or dispatching) them, which means a wakeup was lost.
+//
+//unpack error test: malformed heads are sent, the receiver survives them (on_unpack_error() doesn't close the link), then valid msgs are sent,
+//all of them must arrive intact, otherwise the next reading was started into a receive buffer which had been given back to buffer_pool.
+
+#define ROUND_TIMEOUT	5 //seconds
+
+#if BOOST_VERSION >= 105300
+boost::atomic_size_t recv_num(0), corrupted_num(0), unpack_error_num(0);
+#else
+st_atomic<size_t> recv_num(0), corrupted_num(0), unpack_error_num(0);
+#endif
+
+class counting_socket : public st_server_socket
+{
+public:
+	counting_socket(i_server& server_) : st_server_socket(server_) {}
+
+protected:
+	virtual void on_unpack_error() {++unpack_error_num;} //keep the link
+	//all bytes of a msg are the same (see send_msgs)
+	virtual bool on_msg_handle(out_msg_type& msg, bool link_down)
+	{
+		if (msg.empty() || std::string::npos != msg.find_first_not_of(msg[0]))
+			++corrupted_num;
+		++recv_num;
+		return true;
+	}
+};
+
+class sending_socket : public st_connector
+{
+public:
+	sending_socket(boost::asio::io_service& io_service_) : st_connector(io_service_) {}
+
+protected:
+	virtual bool on_msg_handle(out_msg_type& msg, bool link_down) {return true;}
+};
+
+typedef st_server_base<counting_socket> test_server;
+typedef st_tcp_client_base<sending_socket> test_client;
+
+static bool wait_until(const boost::function<bool()>& pred, int seconds)
+{
+	boost::system_time deadline = boost::get_system_time() + boost::posix_time::seconds(seconds);
+	while (!pred())
+		if (boost::get_system_time() > deadline)
+			return false;
+		else
+			boost::this_thread::sleep(boost::get_system_time() + boost::posix_time::milliseconds(1));
+
+	return true;
+}
+
+static bool all_received(size_t sent_num) {return recv_num == sent_num;}
+static bool unpack_error_reported(size_t error_num) {return unpack_error_num == error_num;}
+static bool connected(test_server& server_, test_client& client_) {return 1 == server_.size() && client_.at(0)->is_connected();}
+
+static void send_msgs(test_client::object_type sender, size_t j, size_t msg_num, boost::barrier& barrier)
+{
+	char buff[64];
+	for (size_t k = 0; k < 2 * msg_num; ++k)
+	{
+		if (k == msg_num)
+			barrier.wait(); //the second half only races send_handler, nobody else will call send_msg() for them
+		size_t len = 1 + (j + k) % sizeof(buff);
+		memset(buff, 'a' + (int) (k % 26), len);
+		sender->send_msg(buff, len, true);
+	}
+}
+
+//suspend and resume the sending and the peer's msg dispatching concurrently with the first half
+static void suspend_and_resume(test_client::object_type sender, test_server::object_type receiver, size_t msg_num, boost::barrier& barrier)
+{
+	for (size_t k = 0; k < msg_num / 5; ++k)
+	{
+		sender->suspend_send_msg(0 == rand() % 2);
+		receiver->suspend_dispatch_msg(0 == rand() % 2);
+		boost::this_thread::yield();
+	}
+	sender->suspend_send_msg(false);
+	receiver->suspend_dispatch_msg(false);
+	barrier.wait();
+}
+
+static bool send_race_test(test_server& server_, test_client& client_, size_t round_num, size_t thread_num)
+{
+	printf("send race test: " ST_ASIO_SF " rounds, " ST_ASIO_SF " sender threads... ", round_num, thread_num);
+	fflush(stdout);
+
+	test_server::object_type receiver = server_.at(0);
+	test_client::object_type sender = client_.at(0);
+	if (!receiver || !sender)
+	{
+		puts("failed, no link.");
+		return false;
+	}
+
+	size_t sent_num = 0;
+	for (size_t i = 0; i < round_num; ++i)
+	{
+		size_t msg_num = 1 + (size_t) rand() % 50;
+		boost::barrier barrier(thread_num + 1);
+		boost::thread_group threads;
+		for (size_t j = 0; j < thread_num; ++j)
+			threads.create_thread(boost::bind(&send_msgs, sender, j, msg_num, boost::ref(barrier)));
+		threads.create_thread(boost::bind(&suspend_and_resume, sender, receiver, msg_num, boost::ref(barrier)));
+		threads.join_all();
+
+		sent_num += 2 * msg_num * thread_num;
+		if (!wait_until(boost::bind(&all_received, sent_num), ROUND_TIMEOUT))
+		{
+			printf("failed at round " ST_ASIO_SF ", sent " ST_ASIO_SF ", received " ST_ASIO_SF ", pending (send) " ST_ASIO_SF ", pending (recv) " ST_ASIO_SF ".\n",
+				i, sent_num, (size_t) recv_num, sender->get_pending_send_msg_num(), receiver->get_pending_recv_msg_num());
+			return false;
+		}
+	}
+
+	puts("passed.");
+	return true;
+}
+
+static bool unpack_error_test(test_client& client_, size_t round_num)
+{
+	printf("unpack error test: " ST_ASIO_SF " rounds... ", round_num);
+	fflush(stdout);
+
+	test_client::object_type sender = client_.at(0);
+	for (size_t i = 0; i < round_num; ++i)
+	{
+		//a head which claims the msg is shorter than the head itself, the receiver will fail to unpack it with the data kept in its receive buffer
+		size_t error_num = unpack_error_num + 1;
+		sender->send_native_msg("\0\1", 2, true);
+		if (!wait_until(boost::bind(&unpack_error_reported, error_num), ROUND_TIMEOUT))
+		{
+			printf("failed at round " ST_ASIO_SF ", the malformed head has not been reported.\n", i);
+			return false;
+		}
+
+		size_t sent_num = recv_num + 16;
+		for (size_t k = 0; k < 16; ++k)
+		{
+			std::string msg(1 + k * 100, 'a' + (char) k);
+			sender->send_msg(msg, true);
+		}
+		if (!wait_until(boost::bind(&all_received, sent_num), ROUND_TIMEOUT) || corrupted_num > 0)
+		{
+			printf("failed at round " ST_ASIO_SF ", received " ST_ASIO_SF " of " ST_ASIO_SF ", corrupted " ST_ASIO_SF ".\n", i, (size_t) recv_num, sent_num, (size_t) corrupted_num);
+			return false;
+		}
+	}
+
+	puts("passed.");
+	return true;
+}
+
+int main(int argc, const char* argv[])
+{
+	printf("usage: %s [<round number=1000> [<sender thread number=8> [<service thread number=4>]]]\n", argv[0]);
+	if (argc >= 2 && (0 == strcmp(argv[1], "--help") || 0 == strcmp(argv[1], "-h")))
+		return 0;
+
+	size_t round_num = argc > 1 ? std::max(1, atoi(argv[1])) : 1000;
+	size_t thread_num = argc > 2 ? std::max(1, atoi(argv[2])) : 8;
+	int service_thread_num = argc > 3 ? std::max(1, atoi(argv[3])) : 4;
+
+	st_service_pump sp;
+	test_server server_(sp);
+	test_client client_(sp);
+	client_.add_client();
+
+	sp.start_service(service_thread_num);
+	bool re = wait_until(boost::bind(&connected, boost::ref(server_), boost::ref(client_)), ROUND_TIMEOUT) &&
+		send_race_test(server_, client_, round_num, thread_num) && unpack_error_test(client_, std::min(round_num, (size_t) 100));
+	sp.stop_service();
+
+	puts(re ? "all tests passed." : "test failed!");
+	return re ? 0 : 1;
+}
@@ -14,6 +14,8 @@
 //#define ST_ASIO_FULL_STATISTIC //full statistic will slightly impact efficiency.
 #ifdef ST_ASIO_WANT_MSG_SEND_NOTIFY
 #define ST_ASIO_INPUT_QUEUE non_lock_queue //we will never operate sending buffer concurrently, so need no locks.
+#else
+//#define ST_ASIO_INPUT_QUEUE lock_free_queue //compare it with the default lock_queue by test model 2 (many threads send msgs to every link).
 #endif
 //configuration
 
@@ -21,8 +23,9 @@
 #define PACKER_UNPACKER_TYPE	0
 //0-default packer and unpacker, head(length) + body
 //1-default replaceable_packer and replaceable_unpacker, head(length) + body
-//2-fixed length unpacker
+//2-fixed length unpacker, define ST_ASIO_BUFFER_POOL to allocate msgs (basic_buffer) from buffer_pool instead of new operator
 //3-prefix and suffix packer and unpacker
+//#define ST_ASIO_BUFFER_POOL
 
 #if 1 == PACKER_UNPACKER_TYPE
 #define ST_ASIO_DEFAULT_PACKER replaceable_packer<>
@@ -168,9 +171,12 @@ public:
 	statistic get_statistic()
 	{
 		statistic stat;
-		boost::shared_lock<boost::shared_mutex> lock(ST_THIS object_can_mutex);
-		for (BOOST_AUTO(iter, ST_THIS object_can.begin()); iter != ST_THIS object_can.end(); ++iter)
-			stat += (*iter)->get_statistic();
+		for (size_t i = 0; i < ST_THIS shard_num(); ++i)
+		{
+			boost::shared_lock<boost::shared_mutex> lock(ST_THIS shards[i].object_can_mutex);
+			for (BOOST_AUTO(iter, ST_THIS shards[i].object_can.begin()); iter != ST_THIS shards[i].object_can.end(); ++iter)
+				stat += (*iter)->get_statistic();
+		}
 
 		return stat;
 	}
@@ -178,18 +184,20 @@ public:
 	void clear_status() {do_something_to_all(boost::mem_fn(&test_socket::clear_status));}
 	void begin(size_t msg_num, size_t msg_len, char msg_fill) {do_something_to_all(boost::bind(&test_socket::begin, _1, msg_num, msg_len, msg_fill));}
 
+	//test model 2, sender_num threads broadcast msgs concurrently, so every link's send buffer is contended by all of them.
+	void concurrent_broadcast(size_t msg_num, size_t msg_len, char msg_fill, size_t sender_num)
+	{
+		boost::thread_group senders;
+		for (size_t i = 0; i < sender_num; ++i)
+			senders.create_thread(boost::bind(&test_client::broadcast_part, this, i, msg_num, msg_len, msg_fill, sender_num));
+		senders.join_all();
+	}
+
 	void shutdown_some_client(size_t n)
 	{
 		static int index = -1;
 		++index;
 
-#ifdef ST_ASIO_CLEAR_OBJECT_INTERVAL
-		boost::shared_lock<boost::shared_mutex> lock(object_can_mutex);
-#else
-		boost::shared_lock<boost::shared_mutex> lock(object_can_mutex, boost::defer_lock);
-		if ((index % 6) > 2) lock.lock();
-#endif
-
 		switch (index % 6)
 		{
 #ifdef ST_ASIO_CLEAR_OBJECT_INTERVAL
@@ -197,9 +205,7 @@ public:
 			//notice: these methods need to define ST_ASIO_CLEAR_OBJECT_INTERVAL macro, because it just shut down the st_socket,
 			//not really remove them from object pool, this will cause test_client still send data via them, and wait responses from them.
 			//for this scenario, the smaller ST_ASIO_CLEAR_OBJECT_INTERVAL macro is, the better experience you will get, so set it to 1 second.
-		case 0: for (BOOST_AUTO(iter, object_can.begin()); n-- > 0 && iter != object_can.end(); ++iter) (*iter)->graceful_shutdown();				break;
-		case 1: for (BOOST_AUTO(iter, object_can.begin()); n-- > 0 && iter != object_can.end(); ++iter) (*iter)->graceful_shutdown(false, false);	break;
-		case 2: for (BOOST_AUTO(iter, object_can.begin()); n-- > 0 && iter != object_can.end(); ++iter) (*iter)->force_shutdown();					break;
+		case 0: case 1: case 2: do_something_to_one(boost::bind(&test_client::shutdown_client, _1, boost::ref(n), index % 6));	break;
 #else
 			//method #2
 			//this is a equivalence of calling i_server::del_client in st_server_socket_base::on_recv_error(see st_server_socket_base for more details).
@@ -208,9 +214,7 @@ public:
 		case 2: while (n-- > 0) force_shutdown(at(0));				break;
 #endif
 			//if you just want to reconnect to the server, you should do it like this:
-		case 3: for (BOOST_AUTO(iter, object_can.begin()); n-- > 0 && iter != object_can.end(); ++iter) (*iter)->graceful_shutdown(true);			break;
-		case 4: for (BOOST_AUTO(iter, object_can.begin()); n-- > 0 && iter != object_can.end(); ++iter) (*iter)->graceful_shutdown(true, false);	break;
-		case 5: for (BOOST_AUTO(iter, object_can.begin()); n-- > 0 && iter != object_can.end(); ++iter) (*iter)->force_shutdown(true);				break;
+		case 3: case 4: case 5: do_something_to_one(boost::bind(&test_client::shutdown_client, _1, boost::ref(n), index % 6));	break;
 		}
 	}
 
@@ -221,6 +225,39 @@ public:
 	TCP_RANDOM_SEND_MSG(safe_random_send_native_msg, safe_send_native_msg)
 	//msg sending interface
 	///////////////////////////////////////////////////
+
+private:
+	//return true to stop the traversal
+	static bool shutdown_client(object_ctype& item, size_t& n, int method)
+	{
+		if (0 == n)
+			return true;
+
+		--n;
+		switch (method)
+		{
+		case 0: item->graceful_shutdown();				break;
+		case 1: item->graceful_shutdown(false, false);	break;
+		case 2: item->force_shutdown();					break;
+		case 3: item->graceful_shutdown(true);			break;
+		case 4: item->graceful_shutdown(true, false);	break;
+		case 5: item->force_shutdown(true);				break;
+		}
+
+		return false;
+	}
+
+	void broadcast_part(size_t first, size_t msg_num, size_t msg_len, char msg_fill, size_t sender_num)
+	{
+		char* buff = new char[msg_len];
+		memset(buff, msg_fill, msg_len);
+		for (size_t i = first; i < msg_num; i += sender_num)
+		{
+			memcpy(buff, &i, sizeof(size_t)); //seq, the peer will not receive them in order
+			safe_broadcast_msg(buff, msg_len); //can_overflow is false, it's important
+		}
+		delete[] buff;
+	}
 };
 
 int main(int argc, const char* argv[])
@@ -334,7 +371,8 @@ int main(int argc, const char* argv[])
 			size_t msg_num = 1024;
 			size_t msg_len = 1024; //must greater than or equal to sizeof(size_t)
 			char msg_fill = '0';
-			char model = 0; //0 broadcast, 1 randomly pick one link per msg
+			char model = 0; //0 broadcast, 1 randomly pick one link per msg, 2 broadcast by many threads concurrently
+			size_t sender_num = 4; //only for model 2
 
 			boost::char_separator<char> sep(" \t");
 			boost::tokenizer<boost::char_separator<char> > tok(str, sep);
@@ -353,6 +391,7 @@ int main(int argc, const char* argv[])
 #endif
 			if (iter != tok.end()) msg_fill = *iter++->data();
 			if (iter != tok.end()) model = *iter++->data() - '0';
+			if (iter != tok.end()) sender_num = std::max((size_t) atoi(iter++->data()), (size_t) 1);
 
 			unsigned percent = 0;
 			boost::uint64_t total_msg_bytes;
@@ -365,13 +404,19 @@ int main(int argc, const char* argv[])
 				check_msg = false;
 				srand(time(NULL));
 				total_msg_bytes = msg_num; break;
+			case 2:
+				check_msg = false; //msgs from different threads interleave
+				total_msg_bytes = msg_num * link_num; break;
 			default:
 				total_msg_bytes = 0; break;
 			}
 
 			if (total_msg_bytes > 0)
 			{
-				printf("test parameters after adjustment: " ST_ASIO_SF " " ST_ASIO_SF " %c %d\n", msg_num, msg_len, msg_fill, model);
+				printf("test parameters after adjustment: " ST_ASIO_SF " " ST_ASIO_SF " %c %d", msg_num, msg_len, msg_fill, model);
+				if (2 == model)
+					printf(" " ST_ASIO_SF, sender_num);
+				puts("");
 				puts("performance test begin, this application will have no response during the test!");
 
 				client.clear_status();
@@ -404,10 +449,13 @@ int main(int argc, const char* argv[])
 				else
 					puts("if ST_ASIO_WANT_MSG_SEND_NOTIFY defined, only support model 0!");
 #else
+				if (2 == model)
+					client.concurrent_broadcast(msg_num, msg_len, msg_fill, sender_num);
+
 				char* buff = new char[msg_len];
 				memset(buff, msg_fill, msg_len);
 				boost::uint64_t send_bytes = 0;
-				for (size_t i = 0; i < msg_num; ++i)
+				for (size_t i = 0; 2 != model && i < msg_num; ++i)
 				{
 					memcpy(buff, &i, sizeof(size_t)); //seq
 
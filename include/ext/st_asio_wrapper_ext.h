@@ -13,10 +13,24 @@
 #ifndef ST_ASIO_WRAPPER_EXT_H_
 #define ST_ASIO_WRAPPER_EXT_H_
 
+#include <set>
 #include <string>
+#include <vector>
+#include <boost/thread/tss.hpp>
 
 #include "../st_asio_wrapper_base.h"
 
+//basic_buffer allocates its memory from buffer_pool if ST_ASIO_BUFFER_POOL been defined, otherwise, from new operator.
+#ifndef ST_ASIO_BUFFER_POOL_CACHE_SIZE
+#define ST_ASIO_BUFFER_POOL_CACHE_SIZE	64 //maximum idle blocks of each size class cached by each thread
+#endif
+static_assert(ST_ASIO_BUFFER_POOL_CACHE_SIZE > 1, "the thread cache of buffer_pool must be able to hold at least two blocks.");
+
+#ifndef ST_ASIO_BUFFER_POOL_DEPOT_SIZE
+#define ST_ASIO_BUFFER_POOL_DEPOT_SIZE	1024 //maximum idle blocks of each size class kept by the global depot, exceeded ones will be freed
+#endif
+static_assert(ST_ASIO_BUFFER_POOL_DEPOT_SIZE >= ST_ASIO_BUFFER_POOL_CACHE_SIZE, "the depot of buffer_pool must be able to hold a whole thread cache.");
+
 namespace st_asio_wrapper { namespace ext {
 
 //implement i_buffer interface, then string_buffer can be wrapped by replaceable_buffer
@@ -28,6 +42,278 @@ public:
 	virtual const char* data() const {return std::string::data();}
 };
 
+#ifdef _MSC_VER
+#define ST_ASIO_THREAD_LOCAL	__declspec(thread)
+#else
+#define ST_ASIO_THREAD_LOCAL	__thread
+#endif
+
+//size class (powers of 2) based memory pool, idle blocks are cached by each thread (without locking), and exchanged with a global depot (with locking)
+//in batches, so blocks freed in other threads (msgs are generally allocated in io threads but freed in dispatching threads) can be reused.
+class buffer_pool : public boost::noncopyable
+{
+public:
+	static const size_t MIN_BLOCK_SIZE = 64;
+	static const size_t SIZE_CLASS_NUM = 15;
+	static const size_t MAX_BLOCK_SIZE = MIN_BLOCK_SIZE << (SIZE_CLASS_NUM - 1); //bigger blocks will not be pooled
+
+	struct pool_statistic
+	{
+		pool_statistic() : cache_hit_sum(0), depot_hit_sum(0), miss_sum(0), oversize_sum(0), release_sum(0) {}
+
+		uint_fast64_t alloc_sum() const {return cache_hit_sum + depot_hit_sum + miss_sum + oversize_sum;}
+		double hit_rate() const {auto sum = alloc_sum(); return 0 == sum ? 0. : (double) (cache_hit_sum + depot_hit_sum) / sum;}
+
+		pool_statistic& operator +=(const pool_statistic& other)
+		{
+			cache_hit_sum += other.cache_hit_sum;
+			depot_hit_sum += other.depot_hit_sum;
+			miss_sum += other.miss_sum;
+			oversize_sum += other.oversize_sum;
+			release_sum += other.release_sum;
+
+			return *this;
+		}
+
+		std::string to_string() const
+		{
+			std::ostringstream s;
+			s << "allocations: " << alloc_sum() << ", hit rate: " << hit_rate() << " (thread cache: " << cache_hit_sum << ", depot: " << depot_hit_sum
+				<< "), missed: " << miss_sum << ", oversize: " << oversize_sum << ", released: " << release_sum;
+
+			return s.str();
+		}
+
+		uint_fast64_t cache_hit_sum; //allocations served by the thread cache
+		uint_fast64_t depot_hit_sum; //allocations served by the global depot
+		uint_fast64_t miss_sum; //allocations served by new operator
+		uint_fast64_t oversize_sum; //allocations bigger than MAX_BLOCK_SIZE, they will never be pooled
+		uint_fast64_t release_sum; //idle blocks been deleted because both the thread cache and the depot were full
+	};
+
+	//never been destructed, so thread caches can still return their blocks when threads exit after main() returned.
+	static buffer_pool& instance() {static auto pool = new buffer_pool(); return *pool;}
+
+	//block_size returns the real size of the block, it must be passed to free() along with the block.
+	char* allocate(size_t len, size_t& block_size)
+	{
+		auto& cache = get_thread_cache();
+		auto index = size_class(len);
+		if (index >= SIZE_CLASS_NUM)
+		{
+			cache.add_stat(OVERSIZE);
+			block_size = len;
+			return new char[len];
+		}
+
+		block_size = MIN_BLOCK_SIZE << index;
+		auto& list = cache.lists[index];
+		if (0 == list.num)
+		{
+			auto& d = depots[index];
+			boost::lock_guard<boost::mutex> lock(d.mutex);
+			list.num = std::min(d.blocks.size(), (size_t) ST_ASIO_BUFFER_POOL_CACHE_SIZE / 2);
+			std::copy(std::prev(std::end(d.blocks), list.num), std::end(d.blocks), list.blocks);
+			d.blocks.resize(d.blocks.size() - list.num);
+		}
+		else
+		{
+			cache.add_stat(CACHE_HIT);
+			return list.blocks[--list.num];
+		}
+
+		if (0 == list.num)
+		{
+			cache.add_stat(MISS);
+			return new char[block_size];
+		}
+
+		cache.add_stat(DEPOT_HIT);
+		return list.blocks[--list.num];
+	}
+
+	void free(char* block, size_t block_size)
+	{
+		auto index = size_class(block_size);
+		if (index >= SIZE_CLASS_NUM)
+		{
+			delete[] block;
+			return;
+		}
+
+		auto& cache = get_thread_cache();
+		auto& list = cache.lists[index];
+		if (ST_ASIO_BUFFER_POOL_CACHE_SIZE == list.num) //move half of the idle blocks to the depot
+		{
+			auto released = put_to_depot(index, std::next(list.blocks, ST_ASIO_BUFFER_POOL_CACHE_SIZE / 2), ST_ASIO_BUFFER_POOL_CACHE_SIZE - ST_ASIO_BUFFER_POOL_CACHE_SIZE / 2);
+			if (released > 0)
+				cache.add_stat(RELEASE, released);
+			list.num = ST_ASIO_BUFFER_POOL_CACHE_SIZE / 2;
+		}
+
+		list.blocks[list.num++] = block;
+	}
+
+	//statistic of all threads (include exited ones).
+	pool_statistic get_statistic()
+	{
+		boost::lock_guard<boost::mutex> lock(caches_mutex);
+		auto stat = retired_stat;
+		for (auto& item : caches)
+			stat += item->get_statistic();
+
+		return stat;
+	}
+
+	size_t idle_num_in_depot() const
+	{
+		size_t num = 0;
+		for (auto& item : depots)
+		{
+			boost::lock_guard<boost::mutex> lock(item.mutex);
+			num += item.blocks.size();
+		}
+
+		return num;
+	}
+
+private:
+	enum stat_index {CACHE_HIT, DEPOT_HIT, MISS, OVERSIZE, RELEASE, STAT_NUM};
+	struct free_list {size_t num; char* blocks[ST_ASIO_BUFFER_POOL_CACHE_SIZE];};
+	struct thread_cache
+	{
+		thread_cache() {for (auto& item : lists) item.num = 0;}
+		//return all idle blocks to the depot when the thread exits
+		~thread_cache()
+		{
+			auto& pool = buffer_pool::instance();
+			for (size_t i = 0; i < SIZE_CLASS_NUM; ++i)
+				add_stat(RELEASE, pool.put_to_depot(i, lists[i].blocks, lists[i].num));
+			pool.unregister_cache(this);
+			current_cache() = nullptr;
+		}
+
+		pool_statistic get_statistic() const
+		{
+			pool_statistic s;
+			s.cache_hit_sum = stat[CACHE_HIT];
+			s.depot_hit_sum = stat[DEPOT_HIT];
+			s.miss_sum = stat[MISS];
+			s.oversize_sum = stat[OVERSIZE];
+			s.release_sum = stat[RELEASE];
+
+			return s;
+		}
+
+		//only the owner thread writes them, so relaxed operations are enough, other threads read them while gathering statistic.
+#if BOOST_VERSION >= 105300
+		void add_stat(stat_index index, uint_fast64_t value = 1) {stat[index].store(stat[index].load(boost::memory_order_relaxed) + value, boost::memory_order_relaxed);}
+#else
+		void add_stat(stat_index index, uint_fast64_t value = 1) {stat[index] += value;}
+#endif
+
+		free_list lists[SIZE_CLASS_NUM];
+		st_atomic<uint_fast64_t> stat[STAT_NUM];
+	};
+	struct depot
+	{
+		depot() {blocks.reserve(ST_ASIO_BUFFER_POOL_DEPOT_SIZE);}
+
+		std::vector<char*> blocks;
+		mutable boost::mutex mutex;
+	};
+
+	buffer_pool() {}
+
+	static size_t size_class(size_t len) {size_t index = 0; for (auto size = MIN_BLOCK_SIZE; size < len && index < SIZE_CLASS_NUM; size <<= 1, ++index); return index;}
+
+	//thread_specific_ptr is much slower than the compiler's thread local storage, so the latter is used to find the thread cache,
+	//and the former is used to delete it when the thread exits.
+	static thread_cache*& current_cache() {static ST_ASIO_THREAD_LOCAL thread_cache* cache = nullptr; return cache;}
+	thread_cache& get_thread_cache()
+	{
+		auto& cache = current_cache();
+		if (nullptr == cache)
+		{
+			cache = new thread_cache();
+			thread_caches.reset(cache); //delete it when the thread exits
+
+			boost::lock_guard<boost::mutex> lock(caches_mutex);
+			caches.insert(cache);
+		}
+
+		return *cache;
+	}
+
+	void unregister_cache(thread_cache* cache)
+	{
+		boost::lock_guard<boost::mutex> lock(caches_mutex);
+		retired_stat += cache->get_statistic();
+		caches.erase(cache);
+	}
+
+	//return how many blocks been deleted because the depot was full
+	size_t put_to_depot(size_t index, char* const blocks[], size_t num)
+	{
+		auto& d = depots[index];
+		boost::unique_lock<boost::mutex> lock(d.mutex);
+		auto put_num = std::min(num, ST_ASIO_BUFFER_POOL_DEPOT_SIZE - d.blocks.size());
+		d.blocks.insert(std::end(d.blocks), blocks, std::next(blocks, put_num));
+		lock.unlock();
+
+		for (auto i = put_num; i < num; ++i)
+			delete[] blocks[i];
+
+		return num - put_num;
+	}
+
+private:
+	depot depots[SIZE_CLASS_NUM];
+	boost::thread_specific_ptr<thread_cache> thread_caches;
+
+	std::set<thread_cache*> caches;
+	pool_statistic retired_stat;
+	boost::mutex caches_mutex;
+};
+
+//receive buffer of the built-in unpackers. by default, it's an array of ST_ASIO_MSG_BUFFER_SIZE bytes, so each st_socket occupies it all the time.
+//if ST_ASIO_LAZY_RECV_BUFFER been defined, the memory will be borrowed from buffer_pool only when there's data to be received or parsed, and be given
+//back as soon as all data been parsed, idle sockets then wait for readability without holding any receive buffers (see i_unpacker::idle).
+//ssl sockets never wait for readability (see st_tcp_socket_base::do_recv_msg), so they still hold a receive buffer while waiting for data.
+#ifdef ST_ASIO_LAZY_RECV_BUFFER
+class recv_buffer : public boost::noncopyable
+{
+public:
+	recv_buffer() : buff(nullptr), block_size(0) {}
+	~recv_buffer() {give_back();}
+
+	bool borrowed() const {return nullptr != buff;}
+	void borrow() {if (nullptr == buff) buff = buffer_pool::instance().allocate(ST_ASIO_MSG_BUFFER_SIZE, block_size);}
+	void give_back() {if (nullptr != buff) {buffer_pool::instance().free(buff, block_size); buff = nullptr;}}
+
+	char* data() {assert(borrowed()); return buff;}
+	const char* data() const {assert(borrowed()); return buff;}
+	static size_t size() {return ST_ASIO_MSG_BUFFER_SIZE;}
+
+	char* begin() {return data();}
+	const char* begin() const {return data();}
+	char* end() {return data() + ST_ASIO_MSG_BUFFER_SIZE;}
+	const char* end() const {return data() + ST_ASIO_MSG_BUFFER_SIZE;}
+
+private:
+	char* buff;
+	size_t block_size;
+};
+#else
+class recv_buffer : public boost::array<char, ST_ASIO_MSG_BUFFER_SIZE>
+{
+public:
+	bool borrowed() const {return true;}
+	void borrow() {}
+	void give_back() {}
+};
+#endif
+
 class basic_buffer : public boost::noncopyable
 {
 public:
@@ -37,14 +323,22 @@ public:
 	~basic_buffer() {clear();}
 
 	basic_buffer& operator=(basic_buffer&& other) {clear(); swap(other); return *this;}
+#ifdef ST_ASIO_BUFFER_POOL
+	void assign(size_t len) {clear(); size_t block_size; auto block = buffer_pool::instance().allocate(len, block_size); do_attach(block, len, block_size);}
+#else
 	void assign(size_t len) {clear(); do_attach(new char[len], len, len);}
+#endif
 
 	//the following five functions are needed by st_asio_wrapper
 	bool empty() const {return 0 == len || nullptr == buff;}
 	size_t size() const {return nullptr == buff ? 0 : len;}
 	const char* data() const {return buff;}
 	void swap(basic_buffer& other) {std::swap(buff, other.buff); std::swap(len, other.len); std::swap(buff_len, other.buff_len);}
+#ifdef ST_ASIO_BUFFER_POOL
+	void clear() {if (nullptr != buff) buffer_pool::instance().free(buff, buff_len); do_detach();}
+#else
 	void clear() {delete[] buff; do_detach();}
+#endif
 
 	//functions needed by packer and unpacker
 	char* data() {return buff;}
@@ -60,6 +354,106 @@ protected:
 	size_t len, buff_len;
 };
 
+//a view (data and length) of a ref-counted slab, many views can share one slab, and the slab will be freed along with the last view,
+//it's copyable (only reference counting), see slab_unpacker. please note that as long as one view is alive, the whole slab will be kept.
+class slab_view
+{
+public:
+	typedef boost::shared_ptr<const char> buffer_type;
+
+	slab_view() : len(0) {}
+	//_buff is generally an alias of the slab (see boost::shared_ptr's aliasing constructor) which points to the first byte of the view.
+	slab_view(const buffer_type& _buff, size_t _len) : buff(_buff), len(_len) {}
+
+	buffer_type raw_buffer() const {return buff;}
+
+	//the following five functions are needed by st_asio_wrapper
+	bool empty() const {return 0 == len;}
+	size_t size() const {return len;}
+	const char* data() const {return buff.get();}
+	void swap(slab_view& other) {buff.swap(other.buff); std::swap(len, other.len);}
+	void clear() {buff.reset(); len = 0;}
+
+private:
+	buffer_type buff;
+	size_t len;
+};
+
+//a msg made up of a small inline head and a list of ref-counted bodies, bodies are referenced rather than copied, so a big body can be shared
+//by many msgs (and sockets). st_tcp_socket_base puts the head and all bodies into the gather list of async_write (see gather_buffers below),
+//so the msg will never be concatenated. a scatter_buffer is not continuous, so it has no data(), this makes the code which needs a continuous
+//msg (st_udp_socket_base, the default gather_buffers, and maybe your on_msg_send) fail to compile, use head() and body() instead.
+class scatter_buffer
+{
+public:
+	typedef shared_buffer<i_buffer> body_type;
+	static const size_t MAX_HEAD_LEN = 8;
+
+	scatter_buffer() : head_len(0), len(0) {}
+	scatter_buffer(const scatter_buffer& other) : head_len(0), len(0) {*this = other;}
+	scatter_buffer(scatter_buffer&& other) : head_len(0), len(0) {swap(other);}
+
+	scatter_buffer& operator=(const scatter_buffer& other)
+	{
+		if (this != &other)
+		{
+			memcpy(head_buff, other.head_buff, other.head_len);
+			head_len = other.head_len;
+			len = other.len;
+			bodies = other.bodies;
+		}
+
+		return *this;
+	}
+	scatter_buffer& operator=(scatter_buffer&& other) {clear(); swap(other); return *this;}
+
+	bool head(const char* _head, size_t _len)
+	{
+		if (_len > MAX_HEAD_LEN || (_len > 0 && nullptr == _head))
+			return false;
+
+		memcpy(head_buff, _head, _len);
+		len += _len;
+		len -= head_len;
+		head_len = _len;
+		return true;
+	}
+	const char* head() const {return head_buff;}
+	size_t head_size() const {return head_len;}
+
+	//the body will be shared (reference counting) rather than copied
+	void append(const body_type& body) {if (!body.empty()) {bodies.push_back(body); len += body.size();}}
+	const std::vector<body_type>& body() const {return bodies;}
+
+	//the following four functions are needed by st_asio_wrapper (data() is not, unless you use the default gather_buffers)
+	bool empty() const {return 0 == len;}
+	size_t size() const {return len;} //the total length of the head and all bodies
+	void swap(scatter_buffer& other)
+	{
+		char temp_buff[MAX_HEAD_LEN];
+		memcpy(temp_buff, head_buff, head_len);
+		memcpy(head_buff, other.head_buff, other.head_len);
+		memcpy(other.head_buff, temp_buff, head_len);
+		std::swap(head_len, other.head_len);
+		std::swap(len, other.len);
+		bodies.swap(other.bodies);
+	}
+	void clear() {head_len = len = 0; bodies.clear();}
+
+private:
+	char head_buff[MAX_HEAD_LEN];
+	size_t head_len, len;
+	std::vector<body_type> bodies;
+};
+
+inline void gather_buffers(const scatter_buffer& msg, std::vector<boost::asio::const_buffer>& bufs)
+{
+	if (msg.head_size() > 0)
+		bufs.push_back(boost::asio::buffer(msg.head(), msg.head_size()));
+	for (auto& item : msg.body())
+		bufs.push_back(boost::asio::buffer(item.data(), item.size()));
+}
+
 }} //namespace
 
 #endif /* ST_ASIO_WRAPPER_EXT_H_ */
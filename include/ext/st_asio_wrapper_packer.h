@@ -121,6 +121,74 @@ public:
 	virtual size_t raw_data_len(typename super::msg_ctype& msg) const {return msg.size() - ST_ASIO_HEAD_LEN;}
 };
 
+//msgs packed by it can be shared by many sockets without copying (only reference counting), see TCP_SHARED_BROADCAST_MSG macro.
+typedef replaceable_packer<shared_buffer<i_buffer>> shared_packer;
+
+//protocol: length + body, the same as packer, but bodies are referenced (reference counting) rather than copied, see scatter_buffer.
+//use the second pack_msg to get zero-copy, the inherited pack_msg still copies the bodies (once) because their owners are unknown.
+class scatter_packer : public i_packer<scatter_buffer>
+{
+public:
+	static size_t get_max_msg_size() {return ST_ASIO_MSG_BUFFER_SIZE - ST_ASIO_HEAD_LEN;}
+
+	using i_packer<msg_type>::pack_msg;
+	virtual msg_type pack_msg(const char* const pstr[], const size_t len[], size_t num, bool native = false)
+	{
+		auto raw_msg = new string_buffer();
+		auto str = packer().pack_msg(pstr, len, num, true);
+		raw_msg->swap(str);
+
+		msg_type::body_type body(raw_msg);
+		return pack_msg(&body, 1, native);
+	}
+
+	msg_type pack_msg(const msg_type::body_type bodies[], size_t num, bool native = false)
+	{
+		msg_type msg;
+		if (nullptr == bodies)
+			return msg;
+
+		auto pre_len = native ? 0 : ST_ASIO_HEAD_LEN;
+		auto total_len = pre_len;
+		for (size_t i = 0; i < num; ++i)
+		{
+			auto last_total_len = total_len;
+			total_len += bodies[i].size();
+			if (last_total_len > total_len || total_len > ST_ASIO_MSG_BUFFER_SIZE) //overflow
+			{
+				unified_out::error_out("pack msg error: length exceeded the ST_ASIO_MSG_BUFFER_SIZE!");
+				return msg;
+			}
+		}
+
+		if (total_len > pre_len)
+		{
+			if (!native)
+			{
+				auto head_len = (ST_ASIO_HEAD_TYPE) total_len;
+				if (total_len != head_len)
+				{
+					unified_out::error_out("pack msg error: length exceeded the header's range!");
+					return msg;
+				}
+
+				head_len = ST_ASIO_HEAD_H2N(head_len);
+				msg.head((const char*) &head_len, ST_ASIO_HEAD_LEN);
+			}
+
+			for (size_t i = 0; i < num; ++i)
+				msg.append(bodies[i]);
+		} //if (total_len > pre_len)
+
+		return msg;
+	}
+
+	//only available when the msg has just one body
+	virtual char* raw_data(msg_type& msg) const {return 1 == msg.body().size() ? const_cast<char*>(msg.body().front().data()) : nullptr;}
+	virtual const char* raw_data(msg_ctype& msg) const {return 1 == msg.body().size() ? msg.body().front().data() : nullptr;}
+	virtual size_t raw_data_len(msg_ctype& msg) const {return msg.size() - msg.head_size();}
+};
+
 //protocol: fixed lenght
 class fixed_length_packer : public packer
 {
@@ -15,6 +15,21 @@
 
 #include <boost/array.hpp>
 
+//prefix_suffix_unpacker::memmem filters candidates with SSE2 (and AVX2 if enabled by the compiler), define this macro to use the scalar version.
+#ifndef ST_ASIO_NO_SIMD_MEMMEM
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ST_ASIO_SSE2_MEMMEM
+#include <emmintrin.h>
+#ifdef __AVX2__
+#define ST_ASIO_AVX2_MEMMEM
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+#endif
+
 #include "st_asio_wrapper_ext.h"
 
 #ifdef ST_ASIO_HUGE_MSG
@@ -74,7 +89,7 @@ public:
 	}
 
 public:
-	virtual void reset_state() {cur_msg_len = -1; remain_len = 0;}
+	virtual void reset_state() {cur_msg_len = -1; remain_len = 0; raw_buff.give_back();}
 	virtual bool parse_msg(size_t bytes_transferred, container_type& msg_can)
 	{
 		boost::container::list<std::pair<const char*, size_t>> msg_pos_can;
@@ -87,6 +102,9 @@ public:
 			memcpy(std::begin(raw_buff), pnext, remain_len); //left behind unparsed data
 		}
 
+		if (0 == remain_len)
+			raw_buff.give_back(); //all data been parsed, see ST_ASIO_LAZY_RECV_BUFFER
+
 		//if unpacking failed, successfully parsed msgs will still returned via msg_can(stick package), please note.
 		return unpack_ok;
 	}
@@ -118,12 +136,226 @@ public:
 	virtual boost::asio::mutable_buffers_1 prepare_next_recv()
 	{
 		assert(remain_len < ST_ASIO_MSG_BUFFER_SIZE);
-		return boost::asio::buffer(boost::asio::buffer(raw_buff) + remain_len);
+		raw_buff.borrow();
+		return boost::asio::buffer(boost::asio::buffer(raw_buff.data(), raw_buff.size()) + remain_len);
+	}
+	virtual bool idle() const {return !raw_buff.borrowed();}
+
+protected:
+	recv_buffer raw_buff;
+	size_t cur_msg_len; //-1 means head not received, so msg length is not available.
+	size_t remain_len; //half-baked msg
+};
+
+//protocol: length + body, the same as unpacker, but raw_buff is used as a ring, so the half-baked msg will never be moved to the beginning
+//of raw_buff (unpacker does it after every parsing), the free space may wrap around, then data will be received into two buffers at once.
+class ring_unpacker : public i_unpacker<std::string>
+{
+public:
+	ring_unpacker() {reset_state();}
+	size_t current_msg_length() const {return cur_msg_len;} //current msg's total length, -1 means not available
+
+public:
+	virtual void reset_state() {cur_msg_len = -1; begin_pos = remain_len = 0;}
+	virtual bool parse_msg(size_t bytes_transferred, container_type& msg_can)
+	{
+		//length + msg
+		remain_len += bytes_transferred;
+		assert(remain_len <= ST_ASIO_MSG_BUFFER_SIZE);
+
+		auto unpack_ok = true;
+		auto msg_num = msg_can.size();
+		while (unpack_ok) //considering stick package problem, we need a loop
+			if ((size_t) -1 != cur_msg_len)
+			{
+				if (cur_msg_len > ST_ASIO_MSG_BUFFER_SIZE || cur_msg_len <= ST_ASIO_HEAD_LEN)
+					unpack_ok = false;
+				else if (remain_len >= cur_msg_len) //one msg received
+				{
+					msg_can.resize(msg_can.size() + 1);
+					peek(ST_ASIO_HEAD_LEN, cur_msg_len - ST_ASIO_HEAD_LEN, msg_can.back());
+					remain_len -= cur_msg_len;
+					begin_pos = 0 == remain_len ? 0 : (begin_pos + cur_msg_len) % ST_ASIO_MSG_BUFFER_SIZE; //rewind to reduce wrapping around
+					cur_msg_len = -1;
+				}
+				else
+					break;
+			}
+			else if (remain_len >= ST_ASIO_HEAD_LEN) //the msg's head been received, stick package found
+				cur_msg_len = peek_head();
+			else
+				break;
+
+		if (msg_can.size() == msg_num) //we should have at least got one msg.
+			unpack_ok = false;
+
+		//if unpacking failed, successfully parsed msgs will still returned via msg_can(stick package), please note.
+		return unpack_ok;
+	}
+
+	//a return value of 0 indicates that the read operation is complete. a non-zero value indicates the maximum number
+	//of bytes to be read on the next call to the stream's async_read_some function. ---boost::asio::async_read
+	//read as many as possible to reduce asynchronous call-back, and don't forget to handle stick package carefully in parse_msg function.
+	virtual size_t completion_condition(const boost::system::error_code& ec, size_t bytes_transferred)
+	{
+		if (ec)
+			return 0;
+
+		auto data_len = remain_len + bytes_transferred;
+		assert(data_len <= ST_ASIO_MSG_BUFFER_SIZE);
+
+		if ((size_t) -1 == cur_msg_len && data_len >= ST_ASIO_HEAD_LEN) //the msg's head been received
+		{
+			cur_msg_len = peek_head();
+			if (cur_msg_len > ST_ASIO_MSG_BUFFER_SIZE || cur_msg_len <= ST_ASIO_HEAD_LEN) //invalid msg, stop reading
+				return 0;
+		}
+
+		return data_len >= cur_msg_len ? 0 : boost::asio::detail::default_max_transfer_size;
+		//read as many as possible except that we have already got an entire msg
+	}
+
+	//only returns the free space before the end of raw_buff, st_tcp_socket_base uses prepare_next_recv_buffers instead.
+	virtual boost::asio::mutable_buffers_1 prepare_next_recv() {return boost::asio::mutable_buffers_1(prepare_next_recv_buffers()[0]);}
+	virtual buffers_type prepare_next_recv_buffers()
+	{
+		assert(remain_len < ST_ASIO_MSG_BUFFER_SIZE);
+		auto free_begin = (begin_pos + remain_len) % ST_ASIO_MSG_BUFFER_SIZE;
+		auto free_len = ST_ASIO_MSG_BUFFER_SIZE - remain_len;
+		auto first_len = std::min(free_len, ST_ASIO_MSG_BUFFER_SIZE - free_begin);
+
+		buffers_type buffers = {{boost::asio::buffer(std::next(raw_buff.data(), free_begin), first_len), boost::asio::buffer(raw_buff.data(), free_len - first_len)}};
+		return buffers;
 	}
 
+protected:
+	//copy len bytes which start from offset (relative to begin_pos), they may wrap around.
+	void peek(size_t offset, size_t len, char* buff) const
+	{
+		auto pos = (begin_pos + offset) % ST_ASIO_MSG_BUFFER_SIZE;
+		auto first_len = std::min(len, ST_ASIO_MSG_BUFFER_SIZE - pos);
+		memcpy(buff, std::next(raw_buff.data(), pos), first_len);
+		memcpy(std::next(buff, first_len), raw_buff.data(), len - first_len);
+	}
+	void peek(size_t offset, size_t len, std::string& msg) const
+	{
+		auto pos = (begin_pos + offset) % ST_ASIO_MSG_BUFFER_SIZE;
+		auto first_len = std::min(len, ST_ASIO_MSG_BUFFER_SIZE - pos);
+		msg.reserve(len);
+		msg.assign(std::next(raw_buff.data(), pos), first_len);
+		msg.append(raw_buff.data(), len - first_len);
+	}
+	size_t peek_head() const {ST_ASIO_HEAD_TYPE head; peek(0, ST_ASIO_HEAD_LEN, (char*) &head); return ST_ASIO_HEAD_N2H(head);}
+
 protected:
 	boost::array<char, ST_ASIO_MSG_BUFFER_SIZE> raw_buff;
 	size_t cur_msg_len; //-1 means head not received, so msg length is not available.
+	size_t begin_pos; //where the half-baked msg begins
+	size_t remain_len; //half-baked msg
+};
+
+//protocol: length + body, the same as unpacker, but msgs are not copied out, they are views (see slab_view) of the slab which data was received into,
+//so many msgs share one allocation (the slab), and a slab will never be used again after it has been filled up (msgs may still be using it),
+//then the half-baked msg will be copied into a new slab. if no msg is using the slab at that time, it will be reused rather than reallocated.
+class slab_unpacker : public i_unpacker<slab_view>
+{
+public:
+	typedef boost::array<char, ST_ASIO_MSG_BUFFER_SIZE> slab_type;
+
+	slab_unpacker() {reset_state();}
+	size_t current_msg_length() const {return cur_msg_len;} //current msg's total length, -1 means not available
+
+public:
+	virtual void reset_state() {slab.reset(); cur_msg_len = -1; begin_pos = remain_len = 0;}
+	virtual bool parse_msg(size_t bytes_transferred, container_type& msg_can)
+	{
+		//length + msg
+		remain_len += bytes_transferred;
+		assert(begin_pos + remain_len <= ST_ASIO_MSG_BUFFER_SIZE);
+
+		auto unpack_ok = true;
+		auto msg_num = msg_can.size();
+		while (unpack_ok) //considering stick package problem, we need a loop
+			if ((size_t) -1 != cur_msg_len)
+			{
+				if (cur_msg_len > ST_ASIO_MSG_BUFFER_SIZE || cur_msg_len <= ST_ASIO_HEAD_LEN)
+					unpack_ok = false;
+				else if (remain_len >= cur_msg_len) //one msg received
+				{
+					msg_can.resize(msg_can.size() + 1);
+					msg_can.back() = slab_view(slab_view::buffer_type(slab, std::next(slab->data(), begin_pos + ST_ASIO_HEAD_LEN)), cur_msg_len - ST_ASIO_HEAD_LEN);
+					remain_len -= cur_msg_len;
+					begin_pos += cur_msg_len;
+					cur_msg_len = -1;
+				}
+				else
+					break;
+			}
+			else if (remain_len >= ST_ASIO_HEAD_LEN) //the msg's head been received, stick package found
+				cur_msg_len = peek_head();
+			else
+				break;
+
+		//we should have at least got one msg, except that the half-baked msg reached the end of the slab.
+		if (msg_can.size() == msg_num && 0 == begin_pos)
+			unpack_ok = false;
+
+		//if unpacking failed, successfully parsed msgs will still returned via msg_can(stick package), please note.
+		return unpack_ok;
+	}
+
+	//a return value of 0 indicates that the read operation is complete. a non-zero value indicates the maximum number
+	//of bytes to be read on the next call to the stream's async_read_some function. ---boost::asio::async_read
+	//read as many as possible to reduce asynchronous call-back, and don't forget to handle stick package carefully in parse_msg function.
+	virtual size_t completion_condition(const boost::system::error_code& ec, size_t bytes_transferred)
+	{
+		if (ec)
+			return 0;
+
+		auto data_len = remain_len + bytes_transferred;
+		assert(begin_pos + data_len <= ST_ASIO_MSG_BUFFER_SIZE);
+
+		if ((size_t) -1 == cur_msg_len && data_len >= ST_ASIO_HEAD_LEN) //the msg's head been received
+		{
+			cur_msg_len = peek_head();
+			if (cur_msg_len > ST_ASIO_MSG_BUFFER_SIZE || cur_msg_len <= ST_ASIO_HEAD_LEN) //invalid msg, stop reading
+				return 0;
+		}
+
+		return data_len >= cur_msg_len ? 0 : boost::asio::detail::default_max_transfer_size;
+		//read as many as possible except that we have already got an entire msg
+	}
+
+	virtual boost::asio::mutable_buffers_1 prepare_next_recv()
+	{
+		//the slab has been filled up, or the current msg cannot be held by the rest of the slab
+		if (!slab || begin_pos + remain_len >= ST_ASIO_MSG_BUFFER_SIZE || ((size_t) -1 != cur_msg_len && begin_pos + cur_msg_len > ST_ASIO_MSG_BUFFER_SIZE))
+			renew_slab();
+
+		return boost::asio::buffer(boost::asio::buffer(*slab) + (begin_pos + remain_len));
+	}
+
+protected:
+	size_t peek_head() const {ST_ASIO_HEAD_TYPE head; memcpy(&head, std::next(slab->data(), begin_pos), ST_ASIO_HEAD_LEN); return ST_ASIO_HEAD_N2H(head);}
+	void renew_slab()
+	{
+		if (slab && 1 == slab.use_count()) //no msg is using this slab
+			memmove(slab->data(), std::next(slab->data(), begin_pos), remain_len);
+		else
+		{
+			auto new_slab = boost::make_shared<slab_type>();
+			if (remain_len > 0)
+				memcpy(new_slab->data(), std::next(slab->data(), begin_pos), remain_len);
+			slab.swap(new_slab);
+		}
+
+		begin_pos = 0;
+	}
+
+protected:
+	boost::shared_ptr<slab_type> slab;
+	size_t cur_msg_len; //-1 means head not received, so msg length is not available.
+	size_t begin_pos; //where the half-baked msg begins
 	size_t remain_len; //half-baked msg
 };
 
@@ -131,11 +363,12 @@ protected:
 class udp_unpacker : public i_udp_unpacker<std::string>
 {
 public:
-	virtual msg_type parse_msg(size_t bytes_transferred) {assert(bytes_transferred <= ST_ASIO_MSG_BUFFER_SIZE); return msg_type(raw_buff.data(), bytes_transferred);}
-	virtual boost::asio::mutable_buffers_1 prepare_next_recv() {return boost::asio::buffer(raw_buff);}
+	virtual msg_type parse_msg(size_t bytes_transferred) {assert(bytes_transferred <= ST_ASIO_MSG_BUFFER_SIZE); msg_type msg(raw_buff.data(), bytes_transferred); raw_buff.give_back(); return msg;}
+	virtual boost::asio::mutable_buffers_1 prepare_next_recv() {raw_buff.borrow(); return boost::asio::buffer(raw_buff.data(), raw_buff.size());}
+	virtual bool idle() const {return !raw_buff.borrowed();}
 
 protected:
-	boost::array<char, ST_ASIO_MSG_BUFFER_SIZE> raw_buff;
+	recv_buffer raw_buff;
 };
 
 //protocol: length + body
@@ -165,6 +398,7 @@ public:
 
 	virtual size_t completion_condition(const boost::system::error_code& ec, size_t bytes_transferred) {return unpacker_.completion_condition(ec, bytes_transferred);}
 	virtual boost::asio::mutable_buffers_1 prepare_next_recv() {return unpacker_.prepare_next_recv();}
+	virtual bool idle() const {return unpacker_.idle();}
 
 protected:
 	unpacker unpacker_;
@@ -185,43 +419,67 @@ public:
 
 		auto raw_msg = new string_buffer();
 		raw_msg->assign(raw_buff.data(), bytes_transferred);
+		raw_buff.give_back();
 		return typename super::msg_type(raw_msg);
 	}
-	virtual boost::asio::mutable_buffers_1 prepare_next_recv() {return boost::asio::buffer(raw_buff);}
+	virtual boost::asio::mutable_buffers_1 prepare_next_recv() {raw_buff.borrow(); return boost::asio::buffer(raw_buff.data(), raw_buff.size());}
+	virtual bool idle() const {return !raw_buff.borrowed();}
 
 protected:
-	boost::array<char, ST_ASIO_MSG_BUFFER_SIZE> raw_buff;
+	recv_buffer raw_buff;
 };
 
 //protocol: length + body
 //this unpacker demonstrate how to forbid memory replication while parsing msgs (let asio write msg directly).
+//a body and the data after it (the next heads, small msgs and the beginning of the next body) are received by one read into two buffers, the body's own
+//buffer and a small scratch area (see i_unpacker::prepare_next_recv_buffers), only data in the latter needs to be copied.
 class non_copy_unpacker : public i_unpacker<basic_buffer>
 {
 public:
+	static const size_t SCRATCH_SIZE = 64 * ST_ASIO_HEAD_LEN;
+
 	non_copy_unpacker() {reset_state();}
 	size_t current_msg_length() const {return raw_buff.size();} //current msg's total length(not include the head), 0 means not available
 
 public:
-	virtual void reset_state() {raw_buff.clear(); step = 0;}
+	virtual void reset_state() {raw_buff.clear(); body_len = scratch_len = 0;}
 	virtual bool parse_msg(size_t bytes_transferred, container_type& msg_can)
 	{
-		if (0 == step) //the head been received
+		if (!raw_buff.empty()) //data goes to the body first, then to the scratch area
 		{
-			assert(!raw_buff.empty());
-			step = 1;
+			auto len = std::min(bytes_transferred, raw_buff.size() - body_len);
+			body_len += len;
+			bytes_transferred -= len;
+			if (body_len == raw_buff.size())
+				got_one_msg(msg_can);
 		}
-		else if (1 == step) //the body been received
+
+		scratch_len += bytes_transferred;
+		assert(scratch_len <= SCRATCH_SIZE);
+
+		size_t pos = 0;
+		while (raw_buff.empty() && scratch_len - pos >= ST_ASIO_HEAD_LEN) //considering stick package problem, we need a loop
 		{
-			assert(!raw_buff.empty());
-			if (bytes_transferred != raw_buff.size())
+			ST_ASIO_HEAD_TYPE head;
+			memcpy(&head, std::next(scratch.data(), pos), ST_ASIO_HEAD_LEN);
+			size_t msg_len = ST_ASIO_HEAD_N2H(head);
+			if (msg_len > ST_ASIO_MSG_BUFFER_SIZE || msg_len <= ST_ASIO_HEAD_LEN) //invalid msg, successfully parsed msgs will still returned via msg_can
 				return false;
 
-			msg_can.resize(msg_can.size() + 1);
-			msg_can.back().swap(raw_buff);
-			step = 0;
+			pos += ST_ASIO_HEAD_LEN;
+			raw_buff.assign(msg_len - ST_ASIO_HEAD_LEN);
+			body_len = std::min(raw_buff.size(), scratch_len - pos);
+			memcpy(raw_buff.data(), std::next(scratch.data(), pos), body_len);
+			pos += body_len;
+			if (body_len == raw_buff.size())
+				got_one_msg(msg_can);
 		}
 
-		return -1 != step;
+		scratch_len -= pos;
+		if (pos > 0 && scratch_len > 0)
+			memmove(scratch.data(), std::next(scratch.data(), pos), scratch_len); //left behind half-baked head
+
+		return true;
 	}
 
 	//a return value of 0 indicates that the read operation is complete. a non-zero value indicates the maximum number
@@ -230,43 +488,41 @@ public:
 	{
 		if (ec)
 			return 0;
+		else if (!raw_buff.empty()) //want the rest of the body, data after it (if any) will be received into the scratch area by the same read
+			return bytes_transferred >= raw_buff.size() - body_len ? 0 : boost::asio::detail::default_max_transfer_size;
 
-		if (0 == step) //want the head
-		{
-			assert(raw_buff.empty());
-
-			if (bytes_transferred < ST_ASIO_HEAD_LEN)
-				return boost::asio::detail::default_max_transfer_size;
+		return scratch_len + bytes_transferred >= ST_ASIO_HEAD_LEN ? 0 : boost::asio::detail::default_max_transfer_size; //want a head
+	}
 
-			assert(ST_ASIO_HEAD_LEN == bytes_transferred);
-			auto cur_msg_len = ST_ASIO_HEAD_N2H(head) - ST_ASIO_HEAD_LEN;
-			if (cur_msg_len > ST_ASIO_MSG_BUFFER_SIZE - ST_ASIO_HEAD_LEN) //invalid msg, stop reading
-				step = -1;
-			else
-				raw_buff.assign(cur_msg_len);
-		}
-		else if (1 == step) //want the body
+	//only returns the first buffer, st_tcp_socket_base uses prepare_next_recv_buffers instead.
+	virtual boost::asio::mutable_buffers_1 prepare_next_recv() {return boost::asio::mutable_buffers_1(prepare_next_recv_buffers()[0]);}
+	virtual buffers_type prepare_next_recv_buffers()
+	{
+		boost::asio::mutable_buffer scratch_buff(std::next(scratch.data(), scratch_len), SCRATCH_SIZE - scratch_len);
+		if (raw_buff.empty())
 		{
-			assert(!raw_buff.empty());
-			return boost::asio::detail::default_max_transfer_size;
+			buffers_type buffers = {{scratch_buff, boost::asio::mutable_buffer()}};
+			return buffers;
 		}
-		else
-			assert(false);
 
-		return 0;
+		assert(0 == scratch_len);
+		buffers_type buffers = {{boost::asio::mutable_buffer(std::next(raw_buff.data(), body_len), raw_buff.size() - body_len), scratch_buff}};
+		return buffers;
 	}
 
-	virtual boost::asio::mutable_buffers_1 prepare_next_recv() {return raw_buff.empty() ? boost::asio::buffer((char*) &head, ST_ASIO_HEAD_LEN) : boost::asio::buffer(raw_buff.data(), raw_buff.size());}
+private:
+	void got_one_msg(container_type& msg_can) {msg_can.resize(msg_can.size() + 1); msg_can.back().swap(raw_buff); body_len = 0;}
 
 private:
-	ST_ASIO_HEAD_TYPE head;
 	//please note that we don't have a fixed size array with maximum size any more(like the default unpacker).
 	//this is very useful if you have a few type of msgs which are very large, fox example: you have a type of very large msg(1M size),
 	//but all others are very small, if you use the default unpacker, all unpackers must have a fixed buffer with at least 1M size, each st_socket has a unpacker,
 	//this will cause your application to occupy very large memory but with very low utilization ratio.
 	//this non_copy_unpacker will resolve above problem, and with another benefit: no memory replication needed any more.
 	msg_type raw_buff;
-	int step; //-1-error format, 0-want the head, 1-want the body
+	size_t body_len; //received bytes of raw_buff
+	boost::array<char, SCRATCH_SIZE> scratch;
+	size_t scratch_len;
 };
 
 //protocol: fixed lenght
@@ -313,6 +569,7 @@ public:
 	const std::string& prefix() const {return _prefix;}
 	const std::string& suffix() const {return _suffix;}
 
+	//scanning is incremental, so before a msg been found, successive calls must be for the same msg (in the same buff).
 	size_t peek_msg(size_t data_len, const char* buff)
 	{
 		assert(nullptr != buff);
@@ -328,35 +585,96 @@ public:
 		auto min_len = _prefix.size() + _suffix.size();
 		if (data_len > min_len)
 		{
-			auto end = (const char*) memmem(std::next(buff, _prefix.size()), data_len - _prefix.size(), _suffix.data(), _suffix.size());
+			auto begin_pos = std::max(_prefix.size(), scanned_len); //don't scan the same data again
+			auto end = (const char*) memmem(std::next(buff, begin_pos), data_len - begin_pos, _suffix.data(), _suffix.size());
 			if (nullptr != end)
 			{
 				first_msg_len = std::distance(buff, end) + _suffix.size(); //got a msg
+				scanned_len = 0;
 				return 0;
 			}
 			else if (data_len >= ST_ASIO_MSG_BUFFER_SIZE)
 				return 0; //invalid msg, stop reading
+
+			scanned_len = data_len - _suffix.size() + 1; //the suffix may begin in the last (_suffix.size() - 1) bytes
 		}
 
 		return boost::asio::detail::default_max_transfer_size; //read as many as possible
 	}
 
-	//like strstr, except support \0 in the middle of mem and sub_mem
+	//like strstr, except support \0 in the middle of mem and sub_mem.
+	//for multi-byte sub_mem, candidates are the positions matching both the first and the last byte of sub_mem, they're filtered 32 (AVX2) or
+	//16 (SSE2) positions at a time, or by memchr (first byte only) if SIMD is not available, and then verified by memcmp.
 	static const void* memmem(const void* mem, size_t len, const void* sub_mem, size_t sub_len)
 	{
-		if (nullptr != mem && nullptr != sub_mem && sub_len <= len)
+		if (nullptr == mem || nullptr == sub_mem || sub_len > len)
+			return nullptr;
+
+		auto p = (const char*) mem;
+		auto sub = (const char*) sub_mem;
+		auto valid_len = len - sub_len; //the last position that sub_mem can begin at
+		size_t i = 0;
+		if (0 == sub_len)
+			return p;
+		else if (1 == sub_len)
+			return memchr(p, sub[0], len); //memchr is already well optimized
+
+#ifdef ST_ASIO_AVX2_MEMMEM
+		auto first_byte = _mm256_set1_epi8(sub[0]);
+		auto last_byte = _mm256_set1_epi8(sub[sub_len - 1]);
+		for (; i + 32 <= valid_len + 1; i += 32)
+		{
+			auto mask = (unsigned) _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first_byte, _mm256_loadu_si256((const __m256i*) (p + i))),
+				_mm256_cmpeq_epi8(last_byte, _mm256_loadu_si256((const __m256i*) (p + i + sub_len - 1)))));
+			for (; 0 != mask; mask &= mask - 1)
+			{
+				auto candidate = p + i + lowest_bit(mask);
+				if (0 == memcmp(candidate, sub, sub_len))
+					return candidate;
+			}
+		}
+#endif
+#ifdef ST_ASIO_SSE2_MEMMEM
+		auto first_byte_16 = _mm_set1_epi8(sub[0]);
+		auto last_byte_16 = _mm_set1_epi8(sub[sub_len - 1]);
+		for (; i + 16 <= valid_len + 1; i += 16)
 		{
-			auto valid_len = len - sub_len;
-			for (size_t i = 0; i <= valid_len; ++i, mem = (const char*) mem + 1)
-				if (0 == memcmp(mem, sub_mem, sub_len))
-					return mem;
+			auto mask = (unsigned) _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first_byte_16, _mm_loadu_si128((const __m128i*) (p + i))),
+				_mm_cmpeq_epi8(last_byte_16, _mm_loadu_si128((const __m128i*) (p + i + sub_len - 1)))));
+			for (; 0 != mask; mask &= mask - 1)
+			{
+				auto candidate = p + i + lowest_bit(mask);
+				if (0 == memcmp(candidate, sub, sub_len))
+					return candidate;
+			}
+		}
+#endif
+
+		while (i <= valid_len) //the tail (or everything without SIMD)
+		{
+			auto candidate = (const char*) memchr(p + i, sub[0], valid_len + 1 - i);
+			if (nullptr == candidate)
+				break;
+			else if (0 == memcmp(candidate, sub, sub_len))
+				return candidate;
+
+			i = candidate - p + 1;
 		}
 
 		return nullptr;
 	}
 
+private:
+#ifdef ST_ASIO_SSE2_MEMMEM
+#ifdef _MSC_VER
+	static size_t lowest_bit(unsigned mask) {unsigned long index; _BitScanForward(&index, mask); return index;}
+#else
+	static size_t lowest_bit(unsigned mask) {return __builtin_ctz(mask);}
+#endif
+#endif
+
 public:
-	virtual void reset_state() {first_msg_len = -1; remain_len = 0;}
+	virtual void reset_state() {first_msg_len = -1; scanned_len = remain_len = 0; raw_buff.give_back();}
 	virtual bool parse_msg(size_t bytes_transferred, container_type& msg_can)
 	{
 		//length + msg
@@ -388,6 +706,9 @@ public:
 		else if (unpack_ok && remain_len > 0)
 			memcpy(std::begin(raw_buff), pnext, remain_len); //left behind unparsed msg
 
+		if (0 == remain_len)
+			raw_buff.give_back(); //all data been parsed, see ST_ASIO_LAZY_RECV_BUFFER
+
 		//if unpacking failed, successfully parsed msgs will still returned via msg_can(stick package), please note.
 		return unpack_ok;
 	}
@@ -409,13 +730,16 @@ public:
 	virtual boost::asio::mutable_buffers_1 prepare_next_recv()
 	{
 		assert(remain_len < ST_ASIO_MSG_BUFFER_SIZE);
-		return boost::asio::buffer(boost::asio::buffer(raw_buff) + remain_len);
+		raw_buff.borrow();
+		return boost::asio::buffer(boost::asio::buffer(raw_buff.data(), raw_buff.size()) + remain_len);
 	}
+	virtual bool idle() const {return !raw_buff.borrowed();}
 
 private:
-	boost::array<char, ST_ASIO_MSG_BUFFER_SIZE> raw_buff;
+	recv_buffer raw_buff;
 	std::string _prefix, _suffix;
 	size_t first_msg_len;
+	size_t scanned_len; //the suffix can't begin before it, see peek_msg
 	size_t remain_len; //half-baked msg
 };
 
@@ -423,7 +747,7 @@ private:
 class stream_unpacker : public i_unpacker<std::string>
 {
 public:
-	virtual void reset_state() {}
+	virtual void reset_state() {raw_buff.give_back();}
 	virtual bool parse_msg(size_t bytes_transferred, container_type& msg_can)
 	{
 		if (0 == bytes_transferred)
@@ -433,14 +757,16 @@ public:
 
 		msg_can.resize(msg_can.size() + 1);
 		msg_can.back().assign(raw_buff.data(), bytes_transferred);
+		raw_buff.give_back();
 		return true;
 	}
 
 	virtual size_t completion_condition(const boost::system::error_code& ec, size_t bytes_transferred) {return ec || bytes_transferred > 0 ? 0 : boost::asio::detail::default_max_transfer_size;}
-	virtual boost::asio::mutable_buffers_1 prepare_next_recv() {return boost::asio::buffer(raw_buff);}
+	virtual boost::asio::mutable_buffers_1 prepare_next_recv() {raw_buff.borrow(); return boost::asio::buffer(raw_buff.data(), raw_buff.size());}
+	virtual bool idle() const {return !raw_buff.borrowed();}
 
 protected:
-	boost::array<char, ST_ASIO_MSG_BUFFER_SIZE> raw_buff;
+	recv_buffer raw_buff;
 };
 
 }} //namespace
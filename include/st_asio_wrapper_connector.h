@@ -160,6 +160,7 @@ protected:
 			if (boost::asio::error::connection_refused != ec && boost::asio::error::network_unreachable != ec && boost::asio::error::timed_out != ec)
 #endif
 			{
+				ST_THIS on_closing();
 				boost::system::error_code ec;
 				ST_THIS lowest_layer().close(ec);
 			}
@@ -14,6 +14,13 @@
 #define ST_ASIO_WRAPPER_CONTAINER_H_
 
 #include <boost/thread.hpp>
+#include <boost/version.hpp>
+#if BOOST_VERSION >= 105300
+#include <boost/atomic.hpp>
+#else
+#include <boost/noncopyable.hpp>
+#include <boost/memory_order.hpp>
+#endif
 #include <boost/container/list.hpp>
 #include <boost/typeof/typeof.hpp>
 
@@ -26,6 +33,8 @@
 	#error message capacity must be bigger than zero.
 #endif
 
+//queues used as msg send and recv buffer, lock_queue, non_lock_queue, lock_free_queue and ring_queue (the last two need boost-1.53 or higher) are available,
+//see each of them for their thread safety.
 #ifndef ST_ASIO_INPUT_QUEUE
 #define ST_ASIO_INPUT_QUEUE lock_queue
 #endif
@@ -39,6 +48,12 @@
 #define ST_ASIO_OUTPUT_CONTAINER list
 #endif
 
+//used to separate variables that are modified by different threads (see ring_queue), to avoid false sharing.
+#ifndef ST_ASIO_CACHE_LINE_SIZE
+#define ST_ASIO_CACHE_LINE_SIZE	64
+#endif
+static_assert(ST_ASIO_CACHE_LINE_SIZE > 0, "cache line size must be bigger than zero.");
+
 namespace st_asio_wrapper
 {
 
@@ -79,6 +94,62 @@ private:
 	boost::shared_mutex mutex;
 };
 
+//atomic variable, st_socket uses it to build lock-free state machines (sending, dispatching and so on).
+//on boost-1.53 or higher, it's just boost::atomic, otherwise, a mutex based emulation (only the functions st_asio_wrapper needs are provided).
+//all operations use the default memory order (sequentially consistent) unless specified, the emulation ignores memory orders.
+#if BOOST_VERSION >= 105300
+template<typename T>
+class st_atomic : public boost::atomic<T>
+{
+public:
+	typedef boost::atomic<T> super;
+
+	st_atomic() : super(T()) {}
+	st_atomic(T value) : super(value) {}
+
+	T operator=(T value) {super::store(value); return value;}
+};
+#else
+template<typename T>
+class st_atomic : public boost::noncopyable
+{
+public:
+	st_atomic() : value_(T()) {}
+	st_atomic(T value) : value_(value) {}
+
+	T load(boost::memory_order = boost::memory_order_seq_cst) const {boost::lock_guard<boost::mutex> lock(mutex); return value_;}
+	void store(T value, boost::memory_order = boost::memory_order_seq_cst) {boost::lock_guard<boost::mutex> lock(mutex); value_ = value;}
+	T exchange(T value) {boost::lock_guard<boost::mutex> lock(mutex); std::swap(value, value_); return value;}
+	bool compare_exchange_strong(T& expected, T desired)
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+		if (expected == value_)
+		{
+			value_ = desired;
+			return true;
+		}
+
+		expected = value_;
+		return false;
+	}
+
+	operator T() const {return load();}
+	T operator=(T value) {store(value); return value;}
+	T operator++() {boost::lock_guard<boost::mutex> lock(mutex); return ++value_;}
+	T operator--() {boost::lock_guard<boost::mutex> lock(mutex); return --value_;}
+	T operator+=(T value) {boost::lock_guard<boost::mutex> lock(mutex); return value_ += value;}
+	T operator-=(T value) {boost::lock_guard<boost::mutex> lock(mutex); return value_ -= value;}
+	T fetch_add(T value, boost::memory_order = boost::memory_order_seq_cst) {boost::lock_guard<boost::mutex> lock(mutex); T old = value_; value_ += value; return old;}
+	T fetch_sub(T value, boost::memory_order = boost::memory_order_seq_cst) {boost::lock_guard<boost::mutex> lock(mutex); T old = value_; value_ -= value; return old;}
+	T fetch_or(T value) {boost::lock_guard<boost::mutex> lock(mutex); std::swap(value, value_); value_ |= value; return value;}
+	T fetch_and(T value) {boost::lock_guard<boost::mutex> lock(mutex); std::swap(value, value_); value_ &= value; return value;}
+
+private:
+	T value_;
+	mutable boost::mutex mutex;
+};
+#endif
+
 //Container must at least has the following functions:
 // Container() constructor
 // size
@@ -89,6 +160,7 @@ private:
 // push_back(T&& item)
 // front
 // pop_front
+//T (msg) must have size(), queues count the sum of all items' size() (see size_in_bytes).
 template<typename T, typename Container, typename Lockable>
 class queue : public Container, public Lockable
 {
@@ -97,25 +169,261 @@ public:
 	typedef Container super;
 	typedef queue<T, Container, Lockable> me;
 
-	queue() {}
-	queue(size_t size) : super(size) {}
+	queue() : num_bytes(0) {}
+	queue(size_t size) : super(size), num_bytes(0) {}
+
+	//just like size(), not accurate if the queue is being changed in other threads, but it can be read without locking this queue.
+	size_t size_in_bytes() const {return num_bytes.load(boost::memory_order_relaxed);}
 
 	//not thread-safe
-	void clear() {super::clear();}
-	void swap(me& other) {super::swap(other);}
+	void clear() {super::clear(); num_bytes.store(0, boost::memory_order_relaxed);}
+	void swap(me& other)
+	{
+		super::swap(other);
+		size_t num_bytes_ = num_bytes.load(boost::memory_order_relaxed);
+		num_bytes.store(other.num_bytes.load(boost::memory_order_relaxed), boost::memory_order_relaxed);
+		other.num_bytes.store(num_bytes_, boost::memory_order_relaxed);
+	}
 
 	bool enqueue(const T& item) {typename Lockable::lock_guard lock(*this); return enqueue_(item);}
 	bool enqueue(T&& item) {typename Lockable::lock_guard lock(*this); return enqueue_(std::move(item));}
 	bool try_dequeue(T& item) {typename Lockable::lock_guard lock(*this); return try_dequeue_(item);}
 
-	bool enqueue_(const T& item) {this->push_back(item); return true;}
-	bool enqueue_(T&& item) {this->push_back(std::move(item)); return true;}
-	bool try_dequeue_(T& item) {if (this->empty()) return false; item.swap(this->front()); this->pop_front(); return true;}
+	bool enqueue_(const T& item) {this->push_back(item); num_bytes.fetch_add(item.size(), boost::memory_order_relaxed); return true;}
+	bool enqueue_(T&& item) {num_bytes.fetch_add(item.size(), boost::memory_order_relaxed); this->push_back(std::move(item)); return true;}
+	bool try_dequeue_(T& item) {if (this->empty()) return false; item.swap(this->front()); this->pop_front(); num_bytes.fetch_sub(item.size(), boost::memory_order_relaxed); return true;}
+
+private:
+	st_atomic<size_t> num_bytes; //only changed with this queue locked (or by the only thread which uses it), but size_in_bytes() reads it without locking
 };
 
 template<typename T, typename Container> using non_lock_queue = queue<T, Container, dummy_lockable>; //totally not thread safe
 template<typename T, typename Container> using lock_queue = queue<T, Container, lockable>;
 
+#if BOOST_VERSION >= 105300
+//lock-free multi-producer and single-consumer queue (the intrusive node based algorithm from Dmitry Vyukov),
+//enqueue can be invoked concurrently in any threads without any locks, but try_dequeue and try_dequeue_ must not be invoked concurrently,
+//st_socket guarantees this for its sending buffer (do_send_msg will not be invoked concurrently), so this queue can be used as ST_ASIO_INPUT_QUEUE
+//when many threads send msgs to the same st_socket.
+//but then, you must not invoke pop_first_pending_send_msg or pop_all_pending_send_msg concurrently with msg sending (do_send_msg), they are consumers too,
+//and pop_all_pending_send_msg must not be invoked concurrently with msg senders either, because it swaps this queue (swap is not thread-safe at all).
+//Container is not used, it exists only to make lock_free_queue be able to replace lock_queue and non_lock_queue (by ST_ASIO_INPUT_QUEUE or template arguments).
+//because try_dequeue_ need no locks, lock_guard is a dummy one.
+template<typename T, typename Container>
+class lock_free_queue : public dummy_lockable
+{
+protected:
+	struct node
+	{
+		node() : next(nullptr) {}
+		node(const T& item_) : item(item_), next(nullptr) {}
+		node(T&& item_) : item(std::move(item_)), next(nullptr) {}
+
+		T item;
+		boost::atomic<node*> next;
+	};
+
+public:
+	typedef T data_type;
+	typedef lock_free_queue<T, Container> me;
+
+	lock_free_queue() : head(new node()), num(0), num_bytes(0) {tail = head.load(boost::memory_order_relaxed);}
+	lock_free_queue(size_t size) : head(new node()), num(0), num_bytes(0) {tail = head.load(boost::memory_order_relaxed);} //size is meaningless
+	~lock_free_queue() {clear(); delete tail;}
+
+	//items are counted after been linked, so the consumer can take an item before it's counted, the counters then go below zero for a while.
+	size_t size() const {return non_negative(num.load());} //seq_cst, pairs with the counting in do_enqueue
+	size_t size_in_bytes() const {return non_negative(num_bytes.load(boost::memory_order_relaxed));}
+	bool empty() const {return 0 == size();}
+
+	//not thread-safe
+	void clear() {T item; while (try_dequeue_(item));}
+	void swap(me& other)
+	{
+		auto head_ = head.load(boost::memory_order_relaxed);
+		head.store(other.head.load(boost::memory_order_relaxed), boost::memory_order_relaxed);
+		other.head.store(head_, boost::memory_order_relaxed);
+		std::swap(tail, other.tail);
+
+		auto num_ = num.load(boost::memory_order_relaxed);
+		num.store(other.num.load(boost::memory_order_relaxed), boost::memory_order_relaxed);
+		other.num.store(num_, boost::memory_order_relaxed);
+
+		num_ = num_bytes.load(boost::memory_order_relaxed);
+		num_bytes.store(other.num_bytes.load(boost::memory_order_relaxed), boost::memory_order_relaxed);
+		other.num_bytes.store(num_, boost::memory_order_relaxed);
+	}
+
+	bool enqueue(const T& item) {return enqueue_(item);}
+	bool enqueue(T&& item) {return enqueue_(std::move(item));}
+	bool try_dequeue(T& item) {return try_dequeue_(item);}
+
+	bool enqueue_(const T& item) {do_enqueue(new node(item)); return true;}
+	bool enqueue_(T&& item) {do_enqueue(new node(std::move(item))); return true;}
+	//single consumer
+	bool try_dequeue_(T& item)
+	{
+		auto next = tail->next.load(boost::memory_order_acquire);
+		if (nullptr == next) //empty, or the producer has not linked the new node yet, it will invoke send_msg() after linking, so nothing will be missed
+			return false;
+
+		item.swap(next->item);
+		T().swap(next->item); //next becomes the new dummy node, free the old item (swapped out from the caller) immediately
+		delete tail;
+		tail = next;
+		num.fetch_sub(1, boost::memory_order_relaxed);
+		num_bytes.fetch_sub(item.size(), boost::memory_order_relaxed);
+
+		return true;
+	}
+
+private:
+	static size_t non_negative(size_t n) {return (ptrdiff_t) n < 0 ? 0 : n;}
+
+	void do_enqueue(node* n)
+	{
+		size_t item_size = n->item.size(); //the consumer may free n right after linking
+		auto prev = head.exchange(n, boost::memory_order_acq_rel);
+		prev->next.store(n, boost::memory_order_release);
+		//count after linking, so empty() never reports an item which try_dequeue_ cannot take yet (the sender will not spin on it),
+		//the producer invokes send_msg() after enqueuing, so an item linked but not counted yet will not be missed.
+		//seq_cst, whoever sees the count also sees the link, and it orders with the SENDING bit of st_socket::send_state (see st_socket::send_msg).
+		num.fetch_add(1);
+		num_bytes.fetch_add(item_size, boost::memory_order_relaxed);
+	}
+
+private:
+	boost::atomic<node*> head; //producers' end, the last node
+	node* tail; //consumer's end, always points to a dummy node
+	boost::atomic_size_t num, num_bytes;
+};
+#endif
+
+#if BOOST_VERSION >= 105300
+//fixed capacity, lock-free single-producer and single-consumer queue, all items are allocated (default constructed) at construction time,
+//so enqueue and dequeue never allocate memory, the capacity is max_size (ST_ASIO_MAX_MSG_NUM by default) rounded up to the power of 2.
+//enqueue_ returns false if the queue is full.
+//st_socket's receiving buffer has exactly one producer (handle_msg) and one consumer (msg dispatching), so this queue can be used as ST_ASIO_OUTPUT_QUEUE,
+//but then, you must not invoke pop_first_pending_recv_msg or pop_all_pending_recv_msg concurrently with msg dispatching.
+//Container is not used, it exists only to make ring_queue be able to replace lock_queue and non_lock_queue (by ST_ASIO_OUTPUT_QUEUE or template arguments).
+//because try_dequeue_ need no locks, lock_guard is a dummy one.
+template<typename T, typename Container>
+class ring_queue : public dummy_lockable
+{
+public:
+	typedef T data_type;
+	typedef ring_queue<T, Container> me;
+
+	ring_queue(size_t max_size = ST_ASIO_MAX_MSG_NUM) : head(0), tail(0), num_bytes(0) {init(max_size);}
+	~ring_queue() {delete[] buff;}
+
+	size_t capacity() const {return mask + 1;}
+	size_t size() const {auto head_ = head.load(boost::memory_order_acquire); return tail.load(boost::memory_order_acquire) - head_;} //load head first, see head and tail
+
+	bool empty() const {return 0 == size();}
+	bool full() const {return size() >= capacity();}
+	size_t size_in_bytes() const {return num_bytes.load(boost::memory_order_relaxed);}
+
+	//not thread-safe
+	void clear() {T item; while (try_dequeue_(item));}
+	void swap(me& other)
+	{
+		auto head_ = head.load(boost::memory_order_relaxed), tail_ = tail.load(boost::memory_order_relaxed);
+		head.store(other.head.load(boost::memory_order_relaxed), boost::memory_order_relaxed);
+		tail.store(other.tail.load(boost::memory_order_relaxed), boost::memory_order_relaxed);
+		other.head.store(head_, boost::memory_order_relaxed);
+		other.tail.store(tail_, boost::memory_order_relaxed);
+		auto num_bytes_ = num_bytes.load(boost::memory_order_relaxed);
+		num_bytes.store(other.num_bytes.load(boost::memory_order_relaxed), boost::memory_order_relaxed);
+		other.num_bytes.store(num_bytes_, boost::memory_order_relaxed);
+
+		std::swap(mask, other.mask);
+		std::swap(buff, other.buff);
+	}
+
+	bool enqueue(const T& item) {return enqueue_(item);}
+	bool enqueue(T&& item) {return enqueue_(std::move(item));}
+	bool try_dequeue(T& item) {return try_dequeue_(item);}
+
+	//single producer
+	bool enqueue_(const T& item) {T unused(item); return enqueue_(std::move(unused));}
+	bool enqueue_(T&& item)
+	{
+		auto tail_ = tail.load(boost::memory_order_relaxed);
+		if (tail_ - head.load(boost::memory_order_acquire) > mask) //full
+			return false;
+
+		slot(tail_).swap(item);
+		num_bytes.fetch_add(slot(tail_).size(), boost::memory_order_relaxed); //count before publishing, so size_in_bytes() never underflows
+		tail.store(tail_ + 1, boost::memory_order_release);
+		return true;
+	}
+
+	//single consumer
+	bool try_dequeue_(T& item)
+	{
+		auto head_ = head.load(boost::memory_order_relaxed);
+		if (head_ == tail.load(boost::memory_order_acquire)) //empty
+			return false;
+
+		item.swap(slot(head_));
+		T().swap(slot(head_)); //free the old item (swapped out from the caller) immediately
+		num_bytes.fetch_sub(item.size(), boost::memory_order_relaxed);
+		head.store(head_ + 1, boost::memory_order_release);
+		return true;
+	}
+
+	//single producer, move items from a container (which has empty, front and pop_front) or another ring_queue (as its single consumer),
+	//publish them all at once (only one atomic store), return the number of moved items.
+	template<typename Q2>
+	size_t move_in(Q2& other, size_t max_num)
+	{
+		auto tail_ = tail.load(boost::memory_order_relaxed);
+		auto num = std::min(max_num, capacity() - (tail_ - head.load(boost::memory_order_acquire)));
+
+		size_t moved = 0, bytes = 0;
+		for (; moved < num && pop_into(other, slot(tail_ + moved)); ++moved)
+			bytes += slot(tail_ + moved).size();
+		if (moved > 0)
+		{
+			num_bytes.fetch_add(bytes, boost::memory_order_relaxed);
+			tail.store(tail_ + moved, boost::memory_order_release);
+		}
+
+		return moved;
+	}
+
+private:
+	void init(size_t max_size)
+	{
+		size_t capacity_ = 1;
+		while (capacity_ < max_size)
+			capacity_ <<= 1;
+
+		mask = capacity_ - 1;
+		buff = new T[capacity_];
+	}
+
+	T& slot(size_t index) {return buff[index & mask];}
+
+	static bool pop_into(me& other, T& item) {return other.try_dequeue_(item);}
+	template<typename Q2>
+	static bool pop_into(Q2& other, T& item) {if (other.empty()) return false; item.swap(other.front()); other.pop_front(); return true;}
+
+private:
+	char padding0[ST_ASIO_CACHE_LINE_SIZE];
+	boost::atomic_size_t head; //consumer's index, only increase
+	char padding1[ST_ASIO_CACHE_LINE_SIZE];
+	boost::atomic_size_t tail; //producer's index, only increase, never be smaller than head
+	char padding2[ST_ASIO_CACHE_LINE_SIZE];
+	boost::atomic_size_t num_bytes; //changed by both the producer and the consumer
+	char padding3[ST_ASIO_CACHE_LINE_SIZE];
+
+	size_t mask;
+	T* buff;
+};
+#endif
+
 //it's not thread safe for 'other', please note. for this queue, depends on 'Q'
 template<typename Q>
 size_t move_items_in(Q& dest, Q& other, size_t max_size = ST_ASIO_MAX_MSG_NUM)
@@ -190,6 +498,27 @@ bool splice_helper(_Can& dest_can, _Can& src_can, size_t max_size = ST_ASIO_MAX_
 	return false;
 }
 
+#if BOOST_VERSION >= 105300
+//fast paths for ring_queue, move items in one batch and publish them with only one atomic store.
+template<typename T, typename Container, typename Q2>
+size_t move_items_in(ring_queue<T, Container>& dest, Q2& other, size_t max_size = ST_ASIO_MAX_MSG_NUM)
+{
+	auto cur_size = dest.size();
+	return cur_size >= max_size ? 0 : dest.move_in(other, max_size - cur_size);
+}
+
+template<typename T, typename Container>
+size_t move_items_in(ring_queue<T, Container>& dest, ring_queue<T, Container>& other, size_t max_size = ST_ASIO_MAX_MSG_NUM)
+{
+	auto cur_size = dest.size();
+	return cur_size >= max_size ? 0 : dest.move_in(other, max_size - cur_size);
+}
+
+template<typename T, typename Container>
+bool splice_helper(ring_queue<T, Container>& dest_can, ring_queue<T, Container>& src_can, size_t max_size = ST_ASIO_MAX_MSG_NUM)
+	{return move_items_in(dest_can, src_can, max_size) > 0;}
+#endif
+
 } //namespace
 
 #endif /* ST_ASIO_WRAPPER_CONTAINER_H_ */
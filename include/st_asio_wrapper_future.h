@@ -0,0 +1,36 @@
+/*
+ * st_asio_wrapper_future.h
+ *
+ *  Created on: 2026-10-17
+ *      Author: youngwolf
+ *		email: mail2tao@163.com
+ *		QQ: 676218192
+ *		Community on QQ: 198941541
+ *
+ * future versions of st_socket's asynchronous waiting, boost/thread/future.hpp is heavy, so only include this file if you need them.
+ */
+
+#ifndef ST_ASIO_WRAPPER_FUTURE_H_
+#define ST_ASIO_WRAPPER_FUTURE_H_
+
+#include <boost/thread/future.hpp>
+
+#include "st_asio_wrapper_socket.h"
+
+namespace st_asio_wrapper
+{
+
+//the future version of st_socket::async_wait_writable, if the socket been reset or destroyed before the send buffer became available,
+//the future will get a broken_promise exception.
+template<typename Socket>
+boost::BOOST_THREAD_FUTURE<void> wait_writable(Socket& socket)
+{
+	auto p = boost::make_shared<boost::promise<void>>();
+	auto f = p->get_future();
+	socket.async_wait_writable([p]() {p->set_value();});
+	return f;
+}
+
+} //namespace
+
+#endif /* ST_ASIO_WRAPPER_FUTURE_H_ */
@@ -26,12 +26,16 @@ protected:
 
 public:
 	bool stopped() const {return io_service_.stopped();}
+	boost::asio::io_service& get_io_service() {return io_service_;}
 
 #ifdef ST_ASIO_ENHANCED_STABILITY
 	template<typename CallbackHandler>
 	void post(const CallbackHandler& handler) {auto unused(async_call_indicator); io_service_.post([=]() {handler();});}
 	template<typename CallbackHandler>
 	void post(CallbackHandler&& handler) {auto unused(async_call_indicator); io_service_.post([=]() {handler();});}
+	//post to another io_service (see ST_ASIO_IO_SERVICE_PER_THREAD), it's still an async call of this st_object
+	template<typename CallbackHandler>
+	void post(boost::asio::io_service& io_service, const CallbackHandler& handler) {auto unused(async_call_indicator); io_service.post([=]() {handler();});}
 	bool is_async_calling() const {return !async_call_indicator.unique();}
 	bool is_last_async_call() const {return async_call_indicator.use_count() <= 2;} //can only be called in callbacks
 
@@ -59,6 +63,8 @@ protected:
 	void post(const CallbackHandler& handler) {io_service_.post(handler);}
 	template<typename CallbackHandler>
 	void post(CallbackHandler&& handler) {io_service_.post(std::move(handler));}
+	template<typename CallbackHandler>
+	void post(boost::asio::io_service& io_service, const CallbackHandler& handler) {io_service.post(handler);}
 	bool is_async_calling() const {return false;}
 	bool is_last_async_call() const {return true;}
 
@@ -13,6 +13,11 @@
 #ifndef ST_ASIO_WRAPPER_SERVER_H_
 #define ST_ASIO_WRAPPER_SERVER_H_
 
+#include <map>
+#include <set>
+#include <cmath>
+#include <numeric>
+
 #include "st_asio_wrapper_object_pool.h"
 
 #ifndef ST_ASIO_SERVER_PORT
@@ -25,12 +30,31 @@ static_assert(ST_ASIO_SERVER_PORT > 0, "server port must be bigger than zero.");
 #endif
 static_assert(ST_ASIO_ASYNC_ACCEPT_NUM > 0, "async accept number must be bigger than zero.");
 
+//how many acceptors listen on the server address, if bigger than 1, all of them will be bound with SO_REUSEPORT, then the kernel will distribute new connections
+//among their listen queues, this resolves the bottleneck of one listen queue under connection storms.
+//with ST_ASIO_IO_SERVICE_PER_THREAD, acceptors will be spread among io_services, so each of them has its own thread.
+//ST_ASIO_ASYNC_ACCEPT_NUM is for each acceptor.
+#ifndef ST_ASIO_ACCEPTOR_NUM
+#define ST_ASIO_ACCEPTOR_NUM		1
+#endif
+static_assert(ST_ASIO_ACCEPTOR_NUM > 0, "acceptor number must be bigger than zero.");
+#if ST_ASIO_ACCEPTOR_NUM > 1 && !defined(SO_REUSEPORT)
+	#error multiple acceptors need SO_REUSEPORT.
+#endif
+
 //in set_server_addr, if the IP is empty, ST_ASIO_TCP_DEFAULT_IP_VERSION will define the IP version, or the IP version will be deduced by the IP address.
 //boost::asio::ip::tcp::v4() means ipv4 and boost::asio::ip::tcp::v6() means ipv6.
 #ifndef ST_ASIO_TCP_DEFAULT_IP_VERSION
 #define ST_ASIO_TCP_DEFAULT_IP_VERSION boost::asio::ip::tcp::v4()
 #endif
 
+//how many subscribers one fan-out task serves in st_server_base::publish, if a topic has more subscribers than this, they will be split into
+//several tasks, the first one runs in the caller's thread, others will be posted to io_services, so service threads can fan out concurrently.
+#ifndef ST_ASIO_PUBLISH_BATCH_SIZE
+#define ST_ASIO_PUBLISH_BATCH_SIZE	256
+#endif
+static_assert(ST_ASIO_PUBLISH_BATCH_SIZE > 0, "publish batch size must be bigger than zero.");
+
 namespace st_asio_wrapper
 {
 
@@ -41,9 +65,70 @@ public:
 	using Pool::TIMER_BEGIN;
 	using Pool::TIMER_END;
 
-	st_server_base(st_service_pump& service_pump_) : Pool(service_pump_), acceptor(service_pump_) {set_server_addr(ST_ASIO_SERVER_PORT);}
+	struct accept_statistic
+	{
+		accept_statistic() : accept_sum(0), refuse_sum(0), error_sum(0) {}
+
+		//accepted connections per second during listening
+		double accept_rate() const {auto ms = listen_duration.total_milliseconds(); return ms > 0 ? 1000.0 * accept_sum / ms : .0;}
+
+		std::string to_string() const
+		{
+			std::ostringstream s;
+			s << "accepted: " << accept_sum << ", refused: " << refuse_sum << ", failed: " << error_sum
+				<< ", listened: " << listen_duration.total_seconds() << "s, rate: " << std::fixed << std::setprecision(1) << accept_rate() << "/s";
+
+			return s.str();
+		}
+
+		uint_fast64_t accept_sum; //accepted and added into st_object_pool
+		uint_fast64_t refuse_sum; //accepted but refused by on_accept() or add_client()
+		uint_fast64_t error_sum; //async_accept failed (exclude operation_aborted)
+		boost::posix_time::time_duration listen_duration;
+	};
+
+	struct publish_statistic
+	{
+		static const size_t LATENCY_BUCKET_NUM = 32;
+
+		publish_statistic() : publish_sum(0), deliver_sum(0), fail_sum(0) {std::fill_n(latency_buckets, LATENCY_BUCKET_NUM, 0);}
+
+		//fan-out latency (from publish() to the last subscriber got the msg in its send buffer) in microseconds, p is in (0, 1], for example, .99 means p99.
+		//the result is the upper bound of the bucket in which the percentile falls, buckets are power of 2, so it's precise within 2x.
+		uint_fast64_t latency_percentile(double p) const
+		{
+			auto total = std::accumulate(latency_buckets, latency_buckets + LATENCY_BUCKET_NUM, (uint_fast64_t) 0);
+			if (0 == total)
+				return 0;
+
+			auto target = std::max((uint_fast64_t) std::ceil(p * total), (uint_fast64_t) 1);
+			uint_fast64_t sum = 0;
+			size_t i = 0;
+			for (; i < LATENCY_BUCKET_NUM - 1 && (sum += latency_buckets[i]) < target; ++i);
+
+			return ((uint_fast64_t) 1 << i) - 1;
+		}
+
+		std::string to_string() const
+		{
+			std::ostringstream s;
+			s << "published: " << publish_sum << ", delivered: " << deliver_sum << ", failed: " << fail_sum
+				<< ", fan-out latency p50: " << latency_percentile(.5) << "us, p90: " << latency_percentile(.9)
+				<< "us, p99: " << latency_percentile(.99) << "us, p999: " << latency_percentile(.999) << "us";
+
+			return s.str();
+		}
+
+		uint_fast64_t publish_sum; //publish() invocations which packed a msg and found subscribers
+		uint_fast64_t deliver_sum; //msgs been put into subscribers' send buffers
+		uint_fast64_t fail_sum; //subscribers' send buffers were full (and can_overflow is false) or subscribers were not sendable (or already gone)
+		//the ith bucket counts fan-outs whose latency is in [2^(i-1), 2^i) microseconds (the 0th bucket means 0us), the last one also counts longer ones.
+		uint_fast64_t latency_buckets[LATENCY_BUCKET_NUM];
+	};
+
+	st_server_base(st_service_pump& service_pump_) : Pool(service_pump_), broadcast_packer_(boost::make_shared<typename Socket::packer_type>()), acceptor(create_acceptors(service_pump_)) {set_server_addr(ST_ASIO_SERVER_PORT);}
 	template<typename Arg>
-	st_server_base(st_service_pump& service_pump_, Arg arg) : Pool(service_pump_, arg), acceptor(service_pump_) {set_server_addr(ST_ASIO_SERVER_PORT);}
+	st_server_base(st_service_pump& service_pump_, Arg arg) : Pool(service_pump_, arg), broadcast_packer_(boost::make_shared<typename Socket::packer_type>()), acceptor(create_acceptors(service_pump_)) {set_server_addr(ST_ASIO_SERVER_PORT);}
 
 	bool set_server_addr(unsigned short port, const std::string& ip = std::string())
 	{
@@ -63,8 +148,28 @@ public:
 	}
 	const boost::asio::ip::tcp::endpoint& get_server_addr() const {return server_addr;}
 
-	void stop_listen() {boost::system::error_code ec; acceptor.cancel(ec); acceptor.close(ec);}
-	bool is_listening() const {return acceptor.is_open();}
+	void stop_listen()
+	{
+		for (auto iter = std::begin(acceptors); iter != std::end(acceptors); ++iter)
+			{boost::system::error_code ec; (*iter)->acceptor.cancel(ec); (*iter)->acceptor.close(ec);}
+	}
+	bool is_listening() const {return std::any_of(std::begin(acceptors), std::end(acceptors), [](const boost::shared_ptr<acceptor_slot>& item) {return item->acceptor.is_open();});}
+
+	size_t acceptor_num() const {return acceptors.size();}
+	accept_statistic get_accept_statistic(size_t index) const
+	{
+		assert(index < acceptors.size());
+		auto& slot = *acceptors[index];
+
+		accept_statistic stat;
+		stat.accept_sum = slot.accept_sum;
+		stat.refuse_sum = slot.refuse_sum;
+		stat.error_sum = slot.error_sum;
+		if (!slot.listen_time.is_not_a_date_time())
+			stat.listen_duration = boost::posix_time::microsec_clock::universal_time() - slot.listen_time;
+
+		return stat;
+	}
 
 	//implement i_server's pure virtual functions
 	virtual st_service_pump& get_service_pump() {return Pool::get_service_pump();}
@@ -72,13 +177,24 @@ public:
 	virtual bool del_client(const boost::shared_ptr<st_timer>& client_ptr)
 	{
 		auto raw_client_ptr(boost::dynamic_pointer_cast<Socket>(client_ptr));
-		return raw_client_ptr && ST_THIS del_object(raw_client_ptr) ? raw_client_ptr->force_shutdown(), true : false;
+		if (!raw_client_ptr || !ST_THIS del_object(raw_client_ptr))
+			return false;
+
+		unsubscribe_all(raw_client_ptr->id());
+		raw_client_ptr->force_shutdown();
+		return true;
 	}
 
-	//do not use graceful_shutdown() as client does, because in this function, object_can_mutex has been locked, graceful_shutdown will wait until on_recv_error() been invoked,
-	//but in on_recv_error(), we need to lock object_can_mutex too(in del_object()), this will cause dead lock
+	//do not use graceful_shutdown() as client does, graceful_shutdown will wait until on_recv_error() been invoked (in which del_client() will be invoked),
+	//clients will be shut down one by one. it's not a dead lock anymore since do_something_to_all traverses a snapshot, but still too slow.
 	void shutdown_all_client() {ST_THIS do_something_to_all([](typename Pool::object_ctype& item) {item->force_shutdown();});}
 
+	//get or change the packer used by shared broadcasting (see TCP_SHARED_BROADCAST_MSG macro), by default, it's a Socket::packer_type.
+	//changing packer at runtime is not thread-safe, please pay special attention.
+	boost::shared_ptr<i_packer<typename Socket::in_msg_type>> inner_packer() {return broadcast_packer_;}
+	boost::shared_ptr<const i_packer<typename Socket::in_msg_type>> inner_packer() const {return broadcast_packer_;}
+	void inner_packer(const boost::shared_ptr<i_packer<typename Socket::in_msg_type>>& _packer_) {broadcast_packer_ = _packer_;}
+
 	///////////////////////////////////////////////////
 	//msg sending interface
 	TCP_BROADCAST_MSG(broadcast_msg, send_msg)
@@ -86,39 +202,150 @@ public:
 	//guarantee send msg successfully even if can_overflow equal to false, success at here just means putting the msg into send buffer successfully
 	TCP_BROADCAST_MSG(safe_broadcast_msg, safe_send_msg)
 	TCP_BROADCAST_MSG(safe_broadcast_native_msg, safe_send_native_msg)
+	//pack msg only once for all clients, see TCP_SHARED_BROADCAST_MSG macro for more details.
+	TCP_SHARED_BROADCAST_MSG(shared_broadcast_msg, false)
+	TCP_SHARED_BROADCAST_MSG(shared_broadcast_native_msg, true)
 	//msg sending interface
 	///////////////////////////////////////////////////
 
-	void disconnect(typename Pool::object_ctype& client_ptr) {ST_THIS del_object(client_ptr); client_ptr->disconnect();}
-	void force_shutdown(typename Pool::object_ctype& client_ptr) {ST_THIS del_object(client_ptr); client_ptr->force_shutdown();}
-	void graceful_shutdown(typename Pool::object_ctype& client_ptr, bool sync = false) {ST_THIS del_object(client_ptr); client_ptr->graceful_shutdown(sync);}
+	///////////////////////////////////////////////////
+	//topic based publish/subscribe
+	//subscribers are clients in this server, they will be unsubscribed from all topics automatically when been deleted (del_client, disconnect,
+	//force_shutdown and graceful_shutdown of this class), broken (st_server_socket_base::on_recv_error) or kicked out (clear_obsoleted_object).
+	//the topic index only holds weak pointers, so it never keeps a client alive. subscriber lists are copy-on-write (per topic), publishing only
+	//locks topic_mutex (shared) to fetch the list, and then works on it without any locks, so it never waits for fanning out of other publishings.
+	//return false if the client doesn't exist (not in this server's object pool) or already subscribed the topic.
+	bool subscribe(const std::string& topic, uint_fast64_t id)
+	{
+		boost::unique_lock<boost::shared_mutex> lock(topic_mutex);
+		auto client_ptr = ST_THIS find(id); //find under topic_mutex, then del_client can't slip between finding and subscribing
+		if (!client_ptr || !subscriptions[id].insert(topic).second)
+			return false;
+
+		auto& subscribers = topics[topic];
+		auto new_subscribers = subscribers ? boost::make_shared<subscriber_list>(*subscribers) : boost::make_shared<subscriber_list>();
+		new_subscribers->insert(std::lower_bound(std::begin(*new_subscribers), std::end(*new_subscribers), id,
+			[](const subscriber& item, uint_fast64_t id) {return item.first < id;}), subscriber(id, client_ptr));
+		subscribers = new_subscribers;
+
+		return true;
+	}
+
+	bool unsubscribe(const std::string& topic, uint_fast64_t id)
+	{
+		boost::unique_lock<boost::shared_mutex> lock(topic_mutex);
+		auto iter = subscriptions.find(id);
+		if (iter == std::end(subscriptions) || 0 == iter->second.erase(topic))
+			return false;
+
+		if (iter->second.empty())
+			subscriptions.erase(iter);
+
+		erase_subscriber(topic, id);
+		return true;
+	}
+
+	//unsubscribe the client from all topics, return how many topics it subscribed.
+	size_t unsubscribe_all(uint_fast64_t id)
+	{
+		boost::unique_lock<boost::shared_mutex> lock(topic_mutex);
+		auto iter = subscriptions.find(id);
+		if (iter == std::end(subscriptions))
+			return 0;
+
+		for (auto& item : iter->second)
+			erase_subscriber(item, id);
+		auto num = iter->second.size();
+		subscriptions.erase(iter);
+
+		return num;
+	}
+
+	void clear_topics()
+	{
+		boost::unique_lock<boost::shared_mutex> lock(topic_mutex);
+		subscriptions.clear();
+		topics.clear();
+	}
+
+	size_t topic_num() const {boost::shared_lock<boost::shared_mutex> lock(topic_mutex); return topics.size();}
+	size_t subscriber_num(const std::string& topic) const {auto subscribers = find_subscribers(topic); return subscribers ? subscribers->size() : 0;}
+
+	//pack msg only once with inner_packer() (like shared_broadcast_msg), then put it into all subscribers' send buffers, see ST_ASIO_PUBLISH_BATCH_SIZE
+	//for how the fan-out been parallelized. return the number of subscribers, when it returns, some of them may not have got the msg yet.
+	size_t publish(const std::string& topic, const char* const pstr[], const size_t len[], size_t num, bool can_overflow = false)
+		{return do_publish(topic, pstr, len, num, false, can_overflow);}
+	size_t publish(const std::string& topic, const char* pstr, size_t len, bool can_overflow = false) {return publish(topic, &pstr, &len, 1, can_overflow);}
+	size_t publish(const std::string& topic, const std::string& str, bool can_overflow = false) {return publish(topic, str.data(), str.size(), can_overflow);}
+
+	size_t publish_native(const std::string& topic, const char* const pstr[], const size_t len[], size_t num, bool can_overflow = false)
+		{return do_publish(topic, pstr, len, num, true, can_overflow);}
+	size_t publish_native(const std::string& topic, const char* pstr, size_t len, bool can_overflow = false) {return publish_native(topic, &pstr, &len, 1, can_overflow);}
+	size_t publish_native(const std::string& topic, const std::string& str, bool can_overflow = false) {return publish_native(topic, str.data(), str.size(), can_overflow);}
+
+	publish_statistic get_publish_statistic() const
+	{
+		publish_statistic stat;
+		stat.publish_sum = publish_sum;
+		stat.deliver_sum = deliver_sum;
+		stat.fail_sum = fail_sum;
+		for (size_t i = 0; i < publish_statistic::LATENCY_BUCKET_NUM; ++i)
+			stat.latency_buckets[i] = latency_buckets[i];
+
+		return stat;
+	}
+	void reset_publish_statistic()
+	{
+		publish_sum = deliver_sum = fail_sum = 0;
+		for (auto& item : latency_buckets)
+			item = 0;
+	}
+	//topic based publish/subscribe
+	///////////////////////////////////////////////////
+
+	void disconnect(typename Pool::object_ctype& client_ptr) {ST_THIS del_object(client_ptr); unsubscribe_all(client_ptr->id()); client_ptr->disconnect();}
+	void force_shutdown(typename Pool::object_ctype& client_ptr) {ST_THIS del_object(client_ptr); unsubscribe_all(client_ptr->id()); client_ptr->force_shutdown();}
+	void graceful_shutdown(typename Pool::object_ctype& client_ptr, bool sync = false)
+		{ST_THIS del_object(client_ptr); unsubscribe_all(client_ptr->id()); client_ptr->graceful_shutdown(sync);}
 
 protected:
 	virtual bool init()
 	{
-		boost::system::error_code ec;
-		acceptor.open(server_addr.protocol(), ec); assert(!ec);
+		for (auto iter = std::begin(acceptors); iter != std::end(acceptors); ++iter)
+		{
+			auto& acceptor = (*iter)->acceptor;
+
+			boost::system::error_code ec;
+			acceptor.open(server_addr.protocol(), ec); assert(!ec);
 #ifndef ST_ASIO_NOT_REUSE_ADDRESS
-		acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true), ec); assert(!ec);
+			acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true), ec); assert(!ec);
 #endif
-		acceptor.bind(server_addr, ec); assert(!ec);
-		if (ec) {get_service_pump().stop(); unified_out::error_out("bind failed."); return false;}
-		acceptor.listen(boost::asio::ip::tcp::acceptor::max_connections, ec); assert(!ec);
-		if (ec) {get_service_pump().stop(); unified_out::error_out("listen failed."); return false;}
+#if ST_ASIO_ACCEPTOR_NUM > 1
+			acceptor.set_option(reuse_port(true), ec); assert(!ec);
+#endif
+			acceptor.bind(server_addr, ec); assert(!ec);
+			if (ec) {get_service_pump().stop_io_service(); unified_out::error_out("bind failed."); return false;}
+			acceptor.listen(boost::asio::ip::tcp::acceptor::max_connections, ec); assert(!ec);
+			if (ec) {get_service_pump().stop_io_service(); unified_out::error_out("listen failed."); return false;}
+
+			(*iter)->reset();
+		}
 
 		ST_THIS start();
 
-		for (auto i = 0; i < ST_ASIO_ASYNC_ACCEPT_NUM; ++i)
-			start_next_accept();
+		for (size_t i = 0; i < acceptors.size(); ++i)
+			for (auto j = 0; j < ST_ASIO_ASYNC_ACCEPT_NUM; ++j)
+				do_start_next_accept(i);
 
 		return true;
 	}
-	virtual void uninit() {ST_THIS stop(); stop_listen(); shutdown_all_client();}
+	virtual void uninit() {ST_THIS stop(); stop_listen(); shutdown_all_client(); clear_topics();}
+	virtual void on_kick_out(typename Pool::object_ctype& client_ptr) {unsubscribe_all(client_ptr->id());}
 	virtual bool on_accept(typename Pool::object_ctype& client_ptr) {return true;}
 
 	//if you want to ignore this error and continue to accept new connections immediately, return true in this virtual function;
 	//if you want to ignore this error and continue to accept new connections after a specific delay, start a timer immediately and return false (don't call stop_listen()),
-	// when the timer ends up, call start_next_accept() in the callback function.
+	// when the timer ends up, call start_next_accept() in the callback function (start_next_accept(i) for the ith acceptor if ST_ASIO_ACCEPTOR_NUM > 1).
 	//otherwise, don't rewrite this virtual function or call st_server_base::on_accept_error() directly after your code.
 	virtual bool on_accept_error(const boost::system::error_code& ec, typename Pool::object_ctype& client_ptr)
 	{
@@ -131,13 +358,18 @@ protected:
 		return false;
 	}
 
-	virtual void start_next_accept()
+	//for the first acceptor, st_server_base invokes this one (not start_next_accept(0)), so overriding either of them works with one acceptor.
+	virtual void start_next_accept() {start_next_accept(0);}
+	//index is the acceptor's index, see ST_ASIO_ACCEPTOR_NUM.
+	virtual void start_next_accept(size_t index)
 	{
 		auto client_ptr = ST_THIS create_object(*this);
-		acceptor.async_accept(client_ptr->lowest_layer(), [=](const boost::system::error_code& ec) {ST_THIS accept_handler(ec, client_ptr);});
+		acceptors[index]->acceptor.async_accept(client_ptr->lowest_layer(), [=](const boost::system::error_code& ec) {ST_THIS accept_handler(ec, client_ptr, index);});
 	}
 
 protected:
+	void do_start_next_accept(size_t index) {if (0 == index) start_next_accept(); else start_next_accept(index);}
+
 	bool add_client(typename Pool::object_ctype& client_ptr)
 	{
 		if (ST_THIS add_object(client_ptr))
@@ -151,22 +383,156 @@ protected:
 		return false;
 	}
 
-	void accept_handler(const boost::system::error_code& ec, typename Pool::object_ctype& client_ptr)
+	void accept_handler(const boost::system::error_code& ec, typename Pool::object_ctype& client_ptr, size_t index)
 	{
 		if (!ec)
 		{
 			if (on_accept(client_ptr) && add_client(client_ptr))
+			{
+				++acceptors[index]->accept_sum;
 				client_ptr->start();
+			}
+			else
+				++acceptors[index]->refuse_sum;
+
+			do_start_next_accept(index);
+		}
+		else
+		{
+			if (boost::asio::error::operation_aborted != ec)
+				++acceptors[index]->error_sum;
+
+			if (on_accept_error(ec, client_ptr))
+				do_start_next_accept(index);
+		}
+	}
+
+private:
+	boost::asio::ip::tcp::acceptor& create_acceptors(st_service_pump& service_pump_)
+	{
+		for (size_t i = 0; i < ST_ASIO_ACCEPTOR_NUM; ++i)
+			acceptors.push_back(boost::make_shared<acceptor_slot>(boost::ref(service_pump_.io_service_at(i))));
+
+		return acceptors.front()->acceptor;
+	}
+
+	//subscribers are sorted by id, the id is kept beside the weak pointer, because an object can be reused (with a new id) before been unsubscribed
+	typedef std::pair<uint_fast64_t, boost::weak_ptr<Socket>> subscriber;
+	typedef std::vector<subscriber> subscriber_list;
+
+	//shared by all fan-out tasks of one publish
+	struct fan_out_task
+	{
+		typename Socket::in_msg_type msg;
+		bool can_overflow;
+		boost::shared_ptr<const subscriber_list> subscribers;
+		boost::posix_time::ptime begin_time;
+		st_atomic<size_t> unfinished;
+	};
+
+	boost::shared_ptr<const subscriber_list> find_subscribers(const std::string& topic) const
+	{
+		boost::shared_lock<boost::shared_mutex> lock(topic_mutex);
+		auto iter = topics.find(topic);
+		return iter != std::end(topics) ? iter->second : boost::shared_ptr<const subscriber_list>();
+	}
+
+	//only copy the subscriber list of this topic, must be called with topic_mutex locked
+	void erase_subscriber(const std::string& topic, uint_fast64_t id)
+	{
+		auto iter = topics.find(topic);
+		if (iter == std::end(topics))
+			return;
+
+		auto new_subscribers = boost::make_shared<subscriber_list>();
+		new_subscribers->reserve(iter->second->size());
+		std::copy_if(std::begin(*iter->second), std::end(*iter->second), std::back_inserter(*new_subscribers),
+			[id](const subscriber& item) {return item.first != id;});
+
+		if (new_subscribers->empty())
+			topics.erase(iter);
+		else
+			iter->second = new_subscribers;
+	}
+
+	size_t do_publish(const std::string& topic, const char* const pstr[], const size_t len[], size_t num, bool native, bool can_overflow)
+	{
+		auto subscribers = find_subscribers(topic);
+		if (!subscribers || subscribers->empty())
+			return 0;
+
+		auto task = boost::make_shared<fan_out_task>();
+		task->msg = broadcast_packer_->pack_msg(pstr, len, num, native);
+		if (task->msg.empty())
+			return 0;
+
+		++publish_sum;
+		task->can_overflow = can_overflow;
+		task->subscribers = subscribers;
+		task->begin_time = boost::posix_time::microsec_clock::universal_time();
+
+		auto task_num = (subscribers->size() + ST_ASIO_PUBLISH_BATCH_SIZE - 1) / ST_ASIO_PUBLISH_BATCH_SIZE;
+		task->unfinished = task_num;
+		auto& service_pump_ = get_service_pump();
+		for (size_t i = 1; i < task_num; ++i)
+			ST_THIS post(service_pump_.io_service_at(i), [this, task, i]() {ST_THIS fan_out(task, i);}); //tracked as async calls of this server
+		fan_out(task, 0);
 
-			start_next_accept();
+		return subscribers->size();
+	}
+
+	void fan_out(const boost::shared_ptr<fan_out_task>& task, size_t index)
+	{
+		auto begin = index * ST_ASIO_PUBLISH_BATCH_SIZE;
+		auto end = std::min(begin + ST_ASIO_PUBLISH_BATCH_SIZE, task->subscribers->size());
+		size_t success = 0;
+		for (auto i = begin; i < end; ++i)
+		{
+			auto& item = (*task->subscribers)[i];
+			auto client_ptr = item.second.lock();
+			if (client_ptr && client_ptr->id() == item.first && client_ptr->direct_send_msg(task->msg, task->can_overflow))
+				++success;
+		}
+
+		deliver_sum += success;
+		fail_sum += end - begin - success;
+		if (0 == --task->unfinished)
+		{
+			auto latency = (boost::posix_time::microsec_clock::universal_time() - task->begin_time).total_microseconds();
+			size_t bucket = 0;
+			for (; latency > 0 && bucket < publish_statistic::LATENCY_BUCKET_NUM - 1; latency >>= 1, ++bucket);
+			++latency_buckets[bucket];
 		}
-		else if (on_accept_error(ec, client_ptr))
-			start_next_accept();
 	}
 
 protected:
+#if ST_ASIO_ACCEPTOR_NUM > 1
+	typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+#endif
+
+	struct acceptor_slot
+	{
+		acceptor_slot(boost::asio::io_service& io_service_) : acceptor(io_service_) {}
+		void reset() {listen_time = boost::posix_time::microsec_clock::universal_time(); accept_sum = refuse_sum = error_sum = 0;}
+
+		boost::asio::ip::tcp::acceptor acceptor;
+		boost::posix_time::ptime listen_time;
+		st_atomic<uint_fast64_t> accept_sum, refuse_sum, error_sum;
+	};
+
 	boost::asio::ip::tcp::endpoint server_addr;
-	boost::asio::ip::tcp::acceptor acceptor;
+	boost::shared_ptr<i_packer<typename Socket::in_msg_type>> broadcast_packer_;
+	std::vector<boost::shared_ptr<acceptor_slot>> acceptors; //fixed after construction, so no locks are needed
+	boost::asio::ip::tcp::acceptor& acceptor; //the first acceptor, it's the only one if ST_ASIO_ACCEPTOR_NUM is 1
+
+private:
+	//topic -> subscribers, a subscriber list is never modified after been put in, but replaced by a new one, so publishings can keep using it.
+	std::map<std::string, boost::shared_ptr<const subscriber_list>> topics;
+	std::map<uint_fast64_t, std::set<std::string>> subscriptions; //id -> topics, to unsubscribe a client from all topics quickly
+	mutable boost::shared_mutex topic_mutex; //protects topics and subscriptions, publishing only locks it (shared) to fetch a subscriber list
+
+	st_atomic<uint_fast64_t> publish_sum, deliver_sum, fail_sum;
+	st_atomic<uint_fast64_t> latency_buckets[publish_statistic::LATENCY_BUCKET_NUM];
 };
 
 } //namespace
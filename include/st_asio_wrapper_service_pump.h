@@ -13,8 +13,14 @@
 #ifndef ST_ASIO_WRAPPER_SERVICE_PUMP_H_
 #define ST_ASIO_WRAPPER_SERVICE_PUMP_H_
 
+#include <vector>
+
 #include "st_asio_wrapper_base.h"
 
+#if defined(ST_ASIO_PIN_SERVICE_THREAD) && defined(__linux__)
+#include <pthread.h>
+#endif
+
 //IO thread number
 //listen, msg send and receive, msg handle(on_msg_handle() and on_msg()) will use these threads
 //keep big enough, no empirical value i can suggest, you must try to find it in your own environment
@@ -23,6 +29,18 @@
 #endif
 static_assert(ST_ASIO_SERVICE_THREAD_NUM > 0, "service thread number be bigger than zero.");
 
+//define ST_ASIO_IO_SERVICE_PER_THREAD macro will make st_service_pump own several io_services (st_service_pump itself is the first one, acceptors and timers
+//of st_object_pool live in it), and every service thread will only run one of them, so threads will not share one reactor and one completion queue anymore.
+//each object (socket) will be bound to one io_service when it's created (see assign_io_service()), after that, all its IO and callbacks happen in that
+//io_service, which means, if one io_service is run by only one thread (the best configuration), a socket's callbacks will never be invoked concurrently.
+//the io_service number is decided by st_service_pump's constructor, service threads will be distributed among io_services one by one,
+//so service thread number should be a multiple of io_service number, st_service_pump will make sure every io_service has at least one thread.
+//please note, loads can only be balanced when creating objects, objects reused from the object pool (ST_ASIO_REUSE_OBJECT) keep their io_service.
+//#define ST_ASIO_IO_SERVICE_PER_THREAD
+
+//define ST_ASIO_PIN_SERVICE_THREAD macro will bind the Nth service thread to the (N % CPU number)th CPU, only Linux and Windows are supported.
+//#define ST_ASIO_PIN_SERVICE_THREAD
+
 namespace st_asio_wrapper
 {
 
@@ -68,7 +86,64 @@ public:
 	typedef const object_type object_ctype;
 	typedef boost::container::list<object_type> container_type;
 
-	st_service_pump() : started(false) {}
+#ifdef ST_ASIO_IO_SERVICE_PER_THREAD
+	enum io_service_policies {ROUND_ROBIN, LEAST_LOAD};
+
+	st_service_pump(int io_service_num_ = ST_ASIO_SERVICE_THREAD_NUM) : started(false), thread_index(0), next_io_service(0), io_service_policy_(ROUND_ROBIN)
+	{
+		assert(io_service_num_ > 0);
+
+		io_services.push_back(boost::make_shared<io_service_slot>(boost::ref(*this)));
+		for (auto i = 1; i < io_service_num_; ++i)
+		{
+			auto io_service_ptr = boost::make_shared<boost::asio::io_service>(1); //concurrency hint, one thread per io_service is recommended
+			io_services.push_back(boost::make_shared<io_service_slot>(boost::ref(*io_service_ptr)));
+			io_services.back()->holder = io_service_ptr;
+		}
+	}
+
+	//how to choose io_service for new objects, it's round robin by default.
+	//LEAST_LOAD means the io_service which has the least objects in st_object_pool (all st_object_pools of this service pump are accumulated).
+	void io_service_policy(io_service_policies policy) {io_service_policy_ = policy;}
+	io_service_policies io_service_policy() const {return io_service_policy_;}
+
+	size_t io_service_num() const {return io_services.size();}
+	size_t io_service_load(size_t index) const {assert(index < io_services.size()); return io_services[index]->load;}
+
+	//st_object_pool will invoke this to get an io_service for new objects, so does st_server_socket_base for accepted sockets.
+	boost::asio::io_service& assign_io_service()
+	{
+		size_t index = ++next_io_service % io_services.size();
+		if (LEAST_LOAD == io_service_policy_)
+			//begin at a round robin position, so objects created in a bunch (before any of them been added into st_object_pool) will still be distributed
+			for (size_t i = 1, min_load = io_services[index]->load; i < io_services.size() && min_load > 0; ++i)
+			{
+				size_t cur_index = (index + i) % io_services.size();
+				size_t load = io_services[cur_index]->load;
+				if (load < min_load)
+				{
+					min_load = load;
+					index = cur_index;
+				}
+			}
+
+		return io_services[index]->io_service_;
+	}
+	//st_server_base spreads its acceptors among io_services via this.
+	boost::asio::io_service& io_service_at(size_t index) {return io_services[index % io_services.size()]->io_service_;}
+
+	//st_object_pool maintains these loads when adding objects into or removing objects from it.
+	void inc_io_service_load(boost::asio::io_service& io_service_) {auto slot = find_io_service(io_service_); if (nullptr != slot) ++slot->load;}
+	void dec_io_service_load(boost::asio::io_service& io_service_) {auto slot = find_io_service(io_service_); if (nullptr != slot) --slot->load;}
+#else
+	st_service_pump() : started(false), thread_index(0) {}
+
+	size_t io_service_num() const {return 1;}
+	boost::asio::io_service& assign_io_service() {return *this;}
+	boost::asio::io_service& io_service_at(size_t index) {return *this;}
+	void inc_io_service_load(boost::asio::io_service& io_service_) {}
+	void dec_io_service_load(boost::asio::io_service& io_service_) {}
+#endif
 
 	object_type find(int id)
 	{
@@ -113,7 +188,7 @@ public:
 		st_asio_wrapper::do_something_to_all(temp_service_can, [this](object_type& item) {ST_THIS stop_and_free(item);});
 	}
 
-	void start_service(int thread_num = ST_ASIO_SERVICE_THREAD_NUM) {if (!is_service_started()) do_service(thread_num);}
+	void start_service(int thread_num = ST_ASIO_SERVICE_THREAD_NUM) {if (!is_service_started()) do_service(std::max(thread_num, (int) io_service_num()));}
 	//stop the service, must be invoked explicitly when the service need to stop, for example, close the application
 	void stop_service()
 	{
@@ -141,10 +216,8 @@ public:
 	{
 		if (!is_service_started())
 		{
-			do_service(thread_num - 1);
-
-			boost::system::error_code ec;
-			run(ec);
+			do_service(std::max(thread_num, (int) io_service_num()) - 1);
+			run_thread(thread_index++); //the calling thread is the last service thread
 
 			wait_service();
 		}
@@ -152,11 +225,45 @@ public:
 	//stop the service, must be invoked explicitly when the service need to stop, for example, close the application
 	//only for service pump started by 'run_service', this function will return immediately,
 	//only the return from 'run_service' means service pump ended.
-	void end_service() {if (is_service_started()) do_something_to_all([](object_type& item) {item->stop_service();});}
+	void end_service()
+	{
+		if (is_service_started())
+		{
+			do_something_to_all([](object_type& item) {item->stop_service();});
+#ifdef ST_ASIO_IO_SERVICE_PER_THREAD
+			//let io_service::run() return after all remaining asynchronous operations been done
+			for (auto iter = std::begin(io_services); iter != std::end(io_services); ++iter)
+				(*iter)->work.reset();
+#endif
+		}
+	}
+
+	//stop all io_services at once, remaining asynchronous operations will not be done, services call this on fatal errors (for example,
+	//st_server_base failed to listen). with ST_ASIO_IO_SERVICE_PER_THREAD, io_service::stop() only stops st_service_pump itself (the first io_service).
+	void stop_io_service()
+	{
+#ifdef ST_ASIO_IO_SERVICE_PER_THREAD
+		for (auto iter = std::begin(io_services); iter != std::end(io_services); ++iter)
+		{
+			(*iter)->work.reset();
+			(*iter)->io_service_.stop();
+		}
+#else
+		stop();
+#endif
+	}
 
 	bool is_running() const {return !stopped();}
 	bool is_service_started() const {return started;}
-	void add_service_thread(int thread_num) {for (auto i = 0; i < thread_num; ++i) service_threads.create_thread([this]() {boost::system::error_code ec; ST_THIS run(ec);});}
+	//with ST_ASIO_IO_SERVICE_PER_THREAD, new threads continue to be distributed among io_services one by one.
+	void add_service_thread(int thread_num)
+	{
+		for (auto i = 0; i < thread_num; ++i)
+		{
+			auto index = thread_index++;
+			service_threads.create_thread([this, index]() {ST_THIS run_thread(index);});
+		}
+	}
 
 protected:
 	void do_service(int thread_num)
@@ -164,10 +271,55 @@ protected:
 		started = true;
 		unified_out::info_out("service pump started.");
 
+		thread_index = 0;
+#ifdef ST_ASIO_IO_SERVICE_PER_THREAD
+		for (auto iter = std::begin(io_services); iter != std::end(io_services); ++iter)
+		{
+			(*iter)->io_service_.reset(); //this is needed when restart service
+			(*iter)->work = boost::make_shared<boost::asio::io_service::work>(boost::ref((*iter)->io_service_));
+		}
+#else
 		reset(); //this is needed when restart service
+#endif
 		do_something_to_all([](object_type& item) {item->start_service();});
 		add_service_thread(thread_num);
 	}
+
+	void run_thread(int index)
+	{
+#ifdef ST_ASIO_PIN_SERVICE_THREAD
+		pin_thread(index);
+#endif
+		boost::system::error_code ec;
+#ifdef ST_ASIO_IO_SERVICE_PER_THREAD
+		run_io_service(io_services[index % io_services.size()]->io_service_, ec);
+#else
+		run_io_service(*this, ec);
+#endif
+	}
+
+#ifdef ST_ASIO_PIN_SERVICE_THREAD
+	static void pin_thread(int index)
+	{
+		auto cpu_num = boost::thread::hardware_concurrency();
+		if (0 == cpu_num)
+			return;
+
+		index %= cpu_num;
+#ifdef __linux__
+		cpu_set_t cpu_set;
+		CPU_ZERO(&cpu_set);
+		CPU_SET(index, &cpu_set);
+		auto re = 0 == pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+#elif defined(_WIN32)
+		auto re = 0 != SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR) 1 << index);
+#else
+		auto re = false;
+#endif
+		if (!re)
+			unified_out::warning_out("failed to bind service thread to CPU %d.", index);
+	}
+#endif
 	void wait_service() {service_threads.join_all(); unified_out::info_out("service pump end."); started = false;}
 
 	void stop_and_free(object_type i_service_)
@@ -186,20 +338,45 @@ protected:
 		return true; //continue this io_service::run, if needed, rewrite this to decide whether to continue or not
 	}
 
-	size_t run(boost::system::error_code& ec)
+	size_t run(boost::system::error_code& ec) {return run_io_service(*this, ec);}
+	size_t run_io_service(boost::asio::io_service& io_service_, boost::system::error_code& ec)
 	{
 		while (true)
 		{
-			try {return io_service::run(ec);}
+			try {return io_service_.run(ec);}
 			catch (const std::exception& e) {if (!on_exception(e)) return 0;}
 		}
 	}
+#else
+	size_t run_io_service(boost::asio::io_service& io_service_, boost::system::error_code& ec) {return io_service_.run(ec);}
 #endif
 
 	DO_SOMETHING_TO_ALL_MUTEX(service_can, service_can_mutex)
 	DO_SOMETHING_TO_ONE_MUTEX(service_can, service_can_mutex)
 
 private:
+#ifdef ST_ASIO_IO_SERVICE_PER_THREAD
+	struct io_service_slot
+	{
+		io_service_slot(boost::asio::io_service& io_service__) : io_service_(io_service__), load(0) {}
+
+		boost::asio::io_service& io_service_;
+		boost::shared_ptr<boost::asio::io_service> holder; //empty for the first slot (st_service_pump itself)
+		boost::shared_ptr<boost::asio::io_service::work> work; //keep io_service::run() from returning while service pump is running
+		st_atomic<size_t> load;
+	};
+
+	//io_service number is small and fixed after construction, so linear searching without locking is fine.
+	io_service_slot* find_io_service(boost::asio::io_service& io_service_)
+	{
+		for (auto iter = std::begin(io_services); iter != std::end(io_services); ++iter)
+			if (&(*iter)->io_service_ == &io_service_)
+				return iter->get();
+
+		return nullptr;
+	}
+#endif
+
 	void add(object_type i_service_)
 	{
 		assert(nullptr != i_service_);
@@ -213,6 +390,14 @@ protected:
 	boost::shared_mutex service_can_mutex;
 	boost::thread_group service_threads;
 	bool started;
+	int thread_index; //the next service thread's index, decides which io_service and CPU the thread uses
+
+#ifdef ST_ASIO_IO_SERVICE_PER_THREAD
+private:
+	std::vector<boost::shared_ptr<io_service_slot>> io_services;
+	st_atomic<size_t> next_io_service;
+	io_service_policies io_service_policy_;
+#endif
 };
 
 } //namespace
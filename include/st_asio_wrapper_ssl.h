@@ -157,7 +157,7 @@ public:
 	boost::asio::ssl::context& ssl_context() {return ctx;}
 
 	using super::create_object;
-	typename st_ssl_object_pool::object_type create_object() {return create_object(ST_THIS sp, ctx);}
+	typename st_ssl_object_pool::object_type create_object() {return create_object(ST_THIS sp.assign_io_service(), ctx);}
 	template<typename Arg>
 	typename st_ssl_object_pool::object_type create_object(Arg& arg) {return create_object(arg, ctx);}
 
@@ -195,28 +195,41 @@ protected:
 		}
 	}
 
-	virtual void start_next_accept()
+	using super::start_next_accept;
+	virtual void start_next_accept(size_t index)
 	{
 		auto client_ptr = ST_THIS create_object(*this);
-		ST_THIS acceptor.async_accept(client_ptr->lowest_layer(), [client_ptr, this](const boost::system::error_code& ec) {ST_THIS accept_handler(ec, client_ptr);});
+		ST_THIS acceptors[index]->acceptor.async_accept(client_ptr->lowest_layer(), [client_ptr, index, this](const boost::system::error_code& ec) {ST_THIS accept_handler(ec, client_ptr, index);});
 	}
 
 private:
-	void accept_handler(const boost::system::error_code& ec, typename st_ssl_server_base::object_ctype& client_ptr)
+	void accept_handler(const boost::system::error_code& ec, typename st_ssl_server_base::object_ctype& client_ptr, size_t index)
 	{
 		if (!ec)
 		{
 			if (ST_THIS on_accept(client_ptr))
-				client_ptr->next_layer().async_handshake(boost::asio::ssl::stream_base::server, [client_ptr, this](const boost::system::error_code& ec) {
+				client_ptr->next_layer().async_handshake(boost::asio::ssl::stream_base::server, [client_ptr, index, this](const boost::system::error_code& ec) {
 					ST_THIS on_handshake(ec, client_ptr);
 					if (!ec && ST_THIS add_client(client_ptr))
+					{
+						++ST_THIS acceptors[index]->accept_sum;
 						client_ptr->start();
+					}
+					else
+						++ST_THIS acceptors[index]->refuse_sum;
 				});
+			else
+				++ST_THIS acceptors[index]->refuse_sum;
 
-			start_next_accept();
+			ST_THIS do_start_next_accept(index);
 		}
 		else
+		{
+			if (boost::asio::error::operation_aborted != ec)
+				++ST_THIS acceptors[index]->error_sum;
+
 			ST_THIS stop_listen();
+		}
 	}
 };
 
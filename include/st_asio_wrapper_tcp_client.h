@@ -28,9 +28,9 @@ public:
 	using super::TIMER_BEGIN;
 	using super::TIMER_END;
 
-	st_tcp_client_base(st_service_pump& service_pump_) : super(service_pump_) {}
+	st_tcp_client_base(st_service_pump& service_pump_) : super(service_pump_), broadcast_packer_(boost::make_shared<typename Socket::packer_type>()) {}
 	template<typename Arg>
-	st_tcp_client_base(st_service_pump& service_pump_, Arg arg) : super(service_pump_, arg) {}
+	st_tcp_client_base(st_service_pump& service_pump_, Arg arg) : super(service_pump_, arg), broadcast_packer_(boost::make_shared<typename Socket::packer_type>()) {}
 
 	//connected link size, may smaller than total object size(st_object_pool::size)
 	size_t valid_size()
@@ -53,6 +53,12 @@ public:
 		return ST_THIS add_client(client_ptr, false) ? client_ptr : typename Pool::object_type();
 	}
 
+	//get or change the packer used by shared broadcasting (see TCP_SHARED_BROADCAST_MSG macro), by default, it's a Socket::packer_type.
+	//changing packer at runtime is not thread-safe, please pay special attention.
+	boost::shared_ptr<i_packer<typename Socket::in_msg_type>> inner_packer() {return broadcast_packer_;}
+	boost::shared_ptr<const i_packer<typename Socket::in_msg_type>> inner_packer() const {return broadcast_packer_;}
+	void inner_packer(const boost::shared_ptr<i_packer<typename Socket::in_msg_type>>& _packer_) {broadcast_packer_ = _packer_;}
+
 	///////////////////////////////////////////////////
 	//msg sending interface
 	TCP_BROADCAST_MSG(broadcast_msg, send_msg)
@@ -61,6 +67,9 @@ public:
 	//success at here just means put the msg into st_tcp_socket_base's send buffer
 	TCP_BROADCAST_MSG(safe_broadcast_msg, safe_send_msg)
 	TCP_BROADCAST_MSG(safe_broadcast_native_msg, safe_send_native_msg)
+	//pack msg only once for all links, see TCP_SHARED_BROADCAST_MSG macro for more details.
+	TCP_SHARED_BROADCAST_MSG(shared_broadcast_msg, false)
+	TCP_SHARED_BROADCAST_MSG(shared_broadcast_native_msg, true)
 	//msg sending interface
 	///////////////////////////////////////////////////
 
@@ -75,6 +84,8 @@ public:
 
 protected:
 	virtual void uninit() {ST_THIS stop(); graceful_shutdown();}
+
+	boost::shared_ptr<i_packer<typename Socket::in_msg_type>> broadcast_packer_;
 };
 
 } //namespace
@@ -13,6 +13,7 @@
 #ifndef ST_ASIO_WRAPPER_TIMER_H_
 #define ST_ASIO_WRAPPER_TIMER_H_
 
+#include <vector>
 #include <boost/container/set.hpp>
 #ifdef ST_ASIO_USE_STEADY_TIMER
 #include <boost/asio/steady_timer.hpp>
@@ -22,10 +23,146 @@
 
 #include "st_asio_wrapper_object.h"
 
+//define ST_ASIO_USE_TIMER_WHEEL macro will make all st_timers in the same io_service share one timer wheel (driven by only one asio timer),
+//instead of one asio timer for each timer id, then starting and stopping timers are O(1) and the reactor's timer queue keeps tiny even with huge number of sockets.
+//the cost is precision, timers will be rounded up to ST_ASIO_TIMER_WHEEL_TICK (they never expire earlier than required, but maybe one tick later).
+//timers longer than ST_ASIO_TIMER_WHEEL_TICK * ST_ASIO_TIMER_WHEEL_SLOT_NUM will go round the wheel more than once, this is still O(1) but a little slower.
+#ifdef ST_ASIO_USE_TIMER_WHEEL
+	#ifndef ST_ASIO_TIMER_WHEEL_TICK
+	#define ST_ASIO_TIMER_WHEEL_TICK		10 //milliseconds
+	#endif
+	static_assert(ST_ASIO_TIMER_WHEEL_TICK > 0, "timer wheel tick must be bigger than zero.");
+
+	#ifndef ST_ASIO_TIMER_WHEEL_SLOT_NUM
+	#define ST_ASIO_TIMER_WHEEL_SLOT_NUM	512
+	#endif
+	static_assert(ST_ASIO_TIMER_WHEEL_SLOT_NUM > 0, "timer wheel slot number must be bigger than zero.");
+#endif
+
 //If you inherit a class from class X, your own timer ids must begin from X::TIMER_END
 namespace st_asio_wrapper
 {
 
+#ifdef ST_ASIO_USE_TIMER_WHEEL
+//hashed timer wheel, one instance per io_service (it's an io_service's service, use boost::asio::use_service to get it).
+//nodes are linked into slots intrusively, so insert and remove need no memory allocation.
+template<typename Timer, typename Duration>
+class st_timer_wheel : public boost::asio::io_service::service
+{
+public:
+	struct node
+	{
+		node() : prev(nullptr), next(nullptr), slot(-1), rounds(0), seq(0) {}
+
+		node* prev;
+		node* next;
+		size_t slot; //-1 means not in the wheel
+		size_t rounds; //how many times the cursor still needs to pass this slot before expiration
+		size_t seq; //changes at each insertion and removal, so users can ignore stale expirations, only access it with the wheel's mutex locked (see is_current)
+		boost::shared_ptr<void> holder; //held while in the wheel, users put their async call indicator here (see st_object)
+		std::function<void()> expire; //invoked with the wheel's mutex locked, so it must not operate the wheel, but post a handler instead
+	};
+
+	static boost::asio::io_service::id id;
+
+	st_timer_wheel(boost::asio::io_service& io_service_) : boost::asio::io_service::service(io_service_), timer(io_service_), slots(ST_ASIO_TIMER_WHEEL_SLOT_NUM, nullptr),
+		cursor(0), size_(0), ticking(false) {}
+
+	void insert(node& n, size_t milliseconds, const boost::shared_ptr<void>& holder = boost::shared_ptr<void>())
+	{
+		boost::lock_guard<boost::mutex> lock(mutex);
+		unlink(n);
+		n.holder = holder;
+
+		//the running tick has partly elapsed, add one more tick to never expire earlier than required
+		size_t ticks = std::max((milliseconds + ST_ASIO_TIMER_WHEEL_TICK - 1) / ST_ASIO_TIMER_WHEEL_TICK + (ticking ? 1 : 0), (size_t) 1);
+		n.slot = (cursor + ticks) % slots.size();
+		n.rounds = (ticks - 1) / slots.size();
+		n.prev = nullptr;
+		n.next = slots[n.slot];
+		if (nullptr != n.next)
+			n.next->prev = &n;
+		slots[n.slot] = &n;
+		++n.seq;
+		++size_;
+
+		if (!ticking)
+		{
+			ticking = true;
+			timer.expires_from_now(Duration(ST_ASIO_TIMER_WHEEL_TICK));
+			timer.async_wait([this](const boost::system::error_code& ec) {ST_THIS tick(ec);});
+		}
+	}
+
+	void remove(node& n) {boost::lock_guard<boost::mutex> lock(mutex); unlink(n); ++n.seq;}
+	//whether n has not been inserted or removed since seq was taken
+	bool is_current(const node& n, size_t seq) {boost::lock_guard<boost::mutex> lock(mutex); return seq == n.seq;}
+
+	size_t size() const {return size_;}
+
+private:
+	virtual void shutdown_service() {boost::system::error_code ec; timer.cancel(ec);}
+	virtual void shutdown() {shutdown_service();}
+
+	void unlink(node& n)
+	{
+		if ((size_t) -1 == n.slot)
+			return;
+
+		if (nullptr != n.prev)
+			n.prev->next = n.next;
+		else
+			slots[n.slot] = n.next;
+		if (nullptr != n.next)
+			n.next->prev = n.prev;
+
+		n.prev = n.next = nullptr;
+		n.slot = -1;
+		n.holder.reset();
+		--size_;
+	}
+
+	void tick(const boost::system::error_code& ec)
+	{
+		if (ec)
+			return;
+
+		boost::lock_guard<boost::mutex> lock(mutex);
+		cursor = (cursor + 1) % slots.size();
+		for (auto n = slots[cursor]; nullptr != n;)
+		{
+			auto next = n->next;
+			if (0 == n->rounds)
+			{
+				auto holder(std::move(n->holder)); //release it after expire() posted its handler, which holds its own copy
+				unlink(*n);
+				n->expire();
+			}
+			else
+				--n->rounds;
+			n = next;
+		}
+
+		if (0 == size_)
+			ticking = false;
+		else
+		{
+			//based on the last expiry, so no drifting, and if this handler was delayed, the wheel will catch up quickly
+			timer.expires_at(timer.expires_at() + Duration(ST_ASIO_TIMER_WHEEL_TICK));
+			timer.async_wait([this](const boost::system::error_code& ec) {ST_THIS tick(ec);});
+		}
+	}
+
+private:
+	Timer timer;
+	std::vector<node*> slots;
+	size_t cursor, size_;
+	bool ticking;
+	boost::mutex mutex;
+};
+template<typename Timer, typename Duration> boost::asio::io_service::id st_timer_wheel<Timer, Duration>::id;
+#endif
+
 //timers are identified by id.
 //for the same timer in the same st_timer, set_timer and stop_timer are not thread safe, please pay special attention.
 //to resolve this defect, we must add a mutex member variable to timer_info, it's not worth
@@ -57,6 +194,10 @@ public:
 	typedef unsigned char tid;
 	static const tid TIMER_END = 0; //user timer's id must begin from parent class' TIMER_END
 
+#ifdef ST_ASIO_USE_TIMER_WHEEL
+	typedef st_timer_wheel<timer_type, milliseconds> timer_wheel;
+#endif
+
 	struct timer_info
 	{
 		enum timer_status {TIMER_OK, TIMER_CANCELED};
@@ -65,7 +206,11 @@ public:
 		timer_status status;
 		size_t milliseconds;
 		std::function<bool(tid)> call_back;
+#ifdef ST_ASIO_USE_TIMER_WHEEL
+		boost::shared_ptr<timer_wheel::node> wheel_node;
+#else
 		boost::shared_ptr<timer_type> timer;
+#endif
 
 		bool operator <(const timer_info& other) const {return id < other.id;}
 	};
@@ -73,7 +218,12 @@ public:
 	typedef const timer_info timer_cinfo;
 	typedef boost::container::set<timer_info> container_type;
 
+#ifdef ST_ASIO_USE_TIMER_WHEEL
+	st_timer(boost::asio::io_service& _io_service_) : st_object(_io_service_), wheel(boost::asio::use_service<timer_wheel>(_io_service_)) {}
+	~st_timer() {stop_all_timer();} //the wheel holds pointers to our timers
+#else
 	st_timer(boost::asio::io_service& _io_service_) : st_object(_io_service_) {}
+#endif
 
 	void update_timer_info(tid id, size_t milliseconds, std::function<bool(tid)>&& call_back, bool start = false)
 	{
@@ -86,9 +236,16 @@ public:
 		{
 			timer_can_mutex.unlock_upgrade_and_lock();
 			iter = timer_can.insert(ti).first;
-			timer_can_mutex.unlock();
 
+			//create the timer before unlocking, because others (for example, stop_all_timer) can visit this item right after unlocking
+#ifdef ST_ASIO_USE_TIMER_WHEEL
+			auto& ti = *iter;
+			iter->wheel_node = boost::make_shared<timer_wheel::node>();
+			iter->wheel_node->expire = [this, &ti]() {ST_THIS on_wheel_expire(ti);}; //only invoked while the node is in the wheel, so ti is valid
+#else
 			iter->timer = boost::make_shared<timer_type>(io_service_);
+#endif
+			timer_can_mutex.unlock();
 		}
 		else
 			timer_can_mutex.unlock_upgrade();
@@ -113,7 +270,7 @@ public:
 
 		boost::shared_lock<boost::shared_mutex> lock(timer_can_mutex);
 		auto iter = timer_can.find(ti);
-		if (iter == std::end(timer_can))
+		if (iter != std::end(timer_can))
 			return *iter;
 		else
 			return ti;
@@ -154,6 +311,49 @@ public:
 protected:
 	void reset() {st_object::reset();}
 
+#ifdef ST_ASIO_USE_TIMER_WHEEL
+#ifdef ST_ASIO_ENHANCED_STABILITY
+	//like make_handler_error, make the timer count as an async call while it's in the wheel
+	void start_timer(timer_cinfo& ti) {wheel.insert(*ti.wheel_node, ti.milliseconds, async_call_indicator);}
+#else
+	void start_timer(timer_cinfo& ti) {wheel.insert(*ti.wheel_node, ti.milliseconds);}
+#endif
+
+	void stop_timer(timer_info& ti)
+	{
+		wheel.remove(*ti.wheel_node);
+		ti.status = timer_info::TIMER_CANCELED;
+	}
+
+	//invoked by the wheel with its mutex locked, so just post, this also let different timers be called concurrently as asio timers do
+	void on_wheel_expire(timer_cinfo& ti)
+	{
+		auto w = &wheel;
+		auto n = ti.wheel_node;
+		auto seq = n->seq;
+		auto id = ti.id;
+		//if the timer has been restarted or stopped (st_timer's destructor stops all timers) after this expiration, seq will not match anymore,
+		//so only touch this st_timer after checking seq, the node and the wheel outlive it.
+		post([this, w, n, seq, id]() {
+			if (w->is_current(*n, seq))
+			{
+				auto& ti = ST_THIS find_timer_info(id);
+				//return true from call_back to continue the timer, or the timer will stop
+				if (timer_info::TIMER_OK == ti.status && ti.call_back(ti.id) && timer_info::TIMER_OK == ti.status)
+					ST_THIS start_timer(ti);
+			}
+		});
+	}
+
+	//the timer must exist
+	timer_cinfo& find_timer_info(tid id)
+	{
+		timer_info ti = {id};
+
+		boost::shared_lock<boost::shared_mutex> lock(timer_can_mutex);
+		return *timer_can.find(ti);
+	}
+#else
 	void start_timer(timer_cinfo& ti)
 	{
 		ti.timer->expires_from_now(milliseconds(ti.milliseconds));
@@ -167,9 +367,13 @@ protected:
 		ti.timer->cancel(ec);
 		ti.status = timer_info::TIMER_CANCELED;
 	}
+#endif
 
 	container_type timer_can;
 	boost::shared_mutex timer_can_mutex;
+#ifdef ST_ASIO_USE_TIMER_WHEEL
+	timer_wheel& wheel;
+#endif
 
 private:
 	using st_object::io_service_;
@@ -43,7 +43,11 @@ public:
 	using super::TIMER_BEGIN;
 	using super::TIMER_END;
 
-	st_udp_socket_base(boost::asio::io_service& io_service_) : super(io_service_), unpacker_(boost::make_shared<Unpacker>()) {}
+	st_udp_socket_base(boost::asio::io_service& io_service_) : super(io_service_)
+#ifndef ST_ASIO_STATIC_UNPACKER
+		, unpacker_(boost::make_shared<Unpacker>())
+#endif
+		{}
 
 	//reset all, be ensure that there's no any operations performed on this st_udp_socket when invoke it
 	//please note, when reuse this st_udp_socket, st_object_pool will invoke reset(), child must re-write this to initialize
@@ -92,12 +96,18 @@ public:
 	void force_shutdown() {show_info("link:", "been shut down."); shutdown();}
 	void graceful_shutdown() {force_shutdown();}
 
+#ifdef ST_ASIO_STATIC_UNPACKER
+	//the unpacker is held by value and called without virtual dispatching, it can be configured but not changed at runtime
+	Unpacker& inner_unpacker() {return *unpacker_;}
+	const Unpacker& inner_unpacker() const {return *unpacker_;}
+#else
 	//get or change the unpacker at runtime
 	//changing unpacker at runtime is not thread-safe, this operation can only be done in on_msg(), reset() or constructor, please pay special attention
 	//we can resolve this defect via mutex, but i think it's not worth, because this feature is not frequently used
 	boost::shared_ptr<i_udp_unpacker<typename Unpacker::msg_type>> inner_unpacker() {return unpacker_;}
 	boost::shared_ptr<const i_udp_unpacker<typename Unpacker::msg_type>> inner_unpacker() const {return unpacker_;}
 	void inner_unpacker(const boost::shared_ptr<i_udp_unpacker<typename Unpacker::msg_type>>& _unpacker_) {unpacker_ = _unpacker_;}
+#endif
 
 	using super::send_msg;
 	///////////////////////////////////////////////////
@@ -145,6 +155,21 @@ protected:
 	}
 
 	virtual void do_recv_msg()
+	{
+		if (unpacker_->idle()) //wait for readability without holding a receive buffer, see i_unpacker::idle
+		{
+			boost::shared_lock<boost::shared_mutex> lock(shutdown_mutex);
+#if BOOST_VERSION >= 106600
+			ST_THIS lowest_layer().async_wait(boost::asio::socket_base::wait_read, ST_THIS make_handler_error([this](const boost::system::error_code& ec) {ST_THIS readable_handler(ec);}));
+#else
+			ST_THIS next_layer().async_receive(boost::asio::null_buffers(), ST_THIS make_handler_error_size([this](const boost::system::error_code& ec, size_t) {ST_THIS readable_handler(ec);}));
+#endif
+		}
+		else
+			do_read_msg();
+	}
+
+	void do_read_msg()
 	{
 		auto recv_buff = unpacker_->prepare_next_recv();
 		assert(boost::asio::buffer_size(recv_buff) > 0);
@@ -187,6 +212,7 @@ protected:
 	}
 
 private:
+	void readable_handler(const boost::system::error_code& ec) {if (ec) recv_handler(ec, 0); else do_read_msg();}
 	void recv_handler(const boost::system::error_code& ec, size_t bytes_transferred)
 	{
 		if (!ec && bytes_transferred > 0)
@@ -225,13 +251,14 @@ private:
 		else
 			ST_THIS on_send_error(ec);
 		last_send_msg.clear();
+		ST_THIS update_send_buffer_state();
 
 		//send msg sequentially, which means second sending only after first sending success
 		//on windows, sending a msg to addr_any may cause errors, please note
 		//for UDP, sending error will not stop subsequence sendings.
 		if (!do_send_msg())
 		{
-			ST_THIS sending = false;
+			ST_THIS end_sending();
 			if (!ST_THIS send_msg_buffer.empty())
 				ST_THIS send_msg(); //just make sure no pending msgs
 		}
@@ -239,7 +266,11 @@ private:
 
 protected:
 	typename super::in_msg last_send_msg;
+#ifdef ST_ASIO_STATIC_UNPACKER
+	static_object<Unpacker> unpacker_;
+#else
 	boost::shared_ptr<i_udp_unpacker<typename Unpacker::msg_type>> unpacker_;
+#endif
 	boost::asio::ip::udp::endpoint peer_addr, local_addr;
 
 	boost::shared_mutex shutdown_mutex;
@@ -12,6 +12,8 @@
 #define ST_ASIO_FULL_STATISTIC //full statistic will slightly impact efficiency.
 #ifdef ST_ASIO_WANT_MSG_SEND_NOTIFY
 #define ST_ASIO_INPUT_QUEUE non_lock_queue //we will never operate sending buffer concurrently, so need no locks.
+#else
+//#define ST_ASIO_INPUT_QUEUE lock_free_queue //compare it with the default lock_queue by test model 2 (many threads send msgs to every link).
 #endif
 //configuration
 
@@ -19,8 +21,9 @@
 #define PACKER_UNPACKER_TYPE	0
 //0-default packer and unpacker, head(length) + body
 //1-default replaceable_packer and replaceable_unpacker, head(length) + body
-//2-fixed length unpacker
+//2-fixed length unpacker, define ST_ASIO_BUFFER_POOL to allocate msgs (basic_buffer) from buffer_pool instead of new operator
 //3-prefix and suffix packer and unpacker
+//#define ST_ASIO_BUFFER_POOL
 
 #if 1 == PACKER_UNPACKER_TYPE
 #define ST_ASIO_DEFAULT_PACKER replaceable_packer<>
@@ -178,6 +181,24 @@ public:
 	void clear_status() {do_something_to_all([](object_ctype& item) {item->clear_status();});}
 	void begin(size_t msg_num, size_t msg_len, char msg_fill) {do_something_to_all([=](object_ctype& item) {item->begin(msg_num, msg_len, msg_fill);});}
 
+	//test model 2, sender_num threads broadcast msgs concurrently, so every link's send buffer is contended by all of them.
+	void concurrent_broadcast(size_t msg_num, size_t msg_len, char msg_fill, size_t sender_num)
+	{
+		boost::thread_group senders;
+		for (size_t i = 0; i < sender_num; ++i)
+			senders.create_thread([=]() {
+				auto buff = new char[msg_len];
+				memset(buff, msg_fill, msg_len);
+				for (auto j = i; j < msg_num; j += sender_num)
+				{
+					memcpy(buff, &j, sizeof(size_t)); //seq, the peer will not receive them in order
+					safe_broadcast_msg(buff, msg_len); //can_overflow is false, it's important
+				}
+				delete[] buff;
+			});
+		senders.join_all();
+	}
+
 	void shutdown_some_client(size_t n)
 	{
 		static auto index = -1;
@@ -327,7 +348,8 @@ int main(int argc, const char* argv[])
 			size_t msg_num = 1024;
 			size_t msg_len = 1024; //must greater than or equal to sizeof(size_t)
 			auto msg_fill = '0';
-			char model = 0; //0 broadcast, 1 randomly pick one link per msg
+			char model = 0; //0 broadcast, 1 randomly pick one link per msg, 2 broadcast by many threads concurrently
+			size_t sender_num = 4; //only for model 2
 
 			boost::char_separator<char> sep(" \t");
 			boost::tokenizer<boost::char_separator<char>> tok(str, sep);
@@ -346,6 +368,7 @@ int main(int argc, const char* argv[])
 #endif
 			if (iter != std::end(tok)) msg_fill = *iter++->data();
 			if (iter != std::end(tok)) model = *iter++->data() - '0';
+			if (iter != std::end(tok)) sender_num = std::max((size_t) atoi(iter++->data()), (size_t) 1);
 
 			unsigned percent = 0;
 			uint64_t total_msg_bytes;
@@ -358,13 +381,19 @@ int main(int argc, const char* argv[])
 				check_msg = false;
 				srand(time(nullptr));
 				total_msg_bytes = msg_num; break;
+			case 2:
+				check_msg = false; //msgs from different threads interleave
+				total_msg_bytes = msg_num * link_num; break;
 			default:
 				total_msg_bytes = 0; break;
 			}
 
 			if (total_msg_bytes > 0)
 			{
-				printf("test parameters after adjustment: " ST_ASIO_SF " " ST_ASIO_SF " %c %d\n", msg_num, msg_len, msg_fill, model);
+				printf("test parameters after adjustment: " ST_ASIO_SF " " ST_ASIO_SF " %c %d", msg_num, msg_len, msg_fill, model);
+				if (2 == model)
+					printf(" " ST_ASIO_SF, sender_num);
+				puts("");
 				puts("performance test begin, this application will have no response during the test!");
 
 				client.clear_status();
@@ -397,10 +426,13 @@ int main(int argc, const char* argv[])
 				else
 					puts("if ST_ASIO_WANT_MSG_SEND_NOTIFY defined, only support model 0!");
 #else
+				if (2 == model)
+					client.concurrent_broadcast(msg_num, msg_len, msg_fill, sender_num);
+
 				auto buff = new char[msg_len];
 				memset(buff, msg_fill, msg_len);
 				uint64_t send_bytes = 0;
-				for (size_t i = 0; i < msg_num; ++i)
+				for (size_t i = 0; 2 != model && i < msg_num; ++i)
 				{
 					memcpy(buff, &i, sizeof(size_t)); //seq
 